@@ -0,0 +1,108 @@
+//
+//	allocation_counter.cpp is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#include "allocation_counter.h"
+
+#ifdef YT_COUNT_ALLOCATIONS
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+static thread_local uint64_t NAllocations = 0;
+
+// array, nothrow and sized forms all end up here or in operator delete(void*)
+void* operator new(size_t size)
+{
+	NAllocations++;
+
+	void* ptr = malloc(size ? size : 1);
+
+	if (!ptr)
+		throw std::bad_alloc();
+
+	return ptr;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	free(ptr);
+}
+
+bool AllocationCounter::isEnabled()
+{
+	return true;
+}
+
+uint64_t AllocationCounter::get()
+{
+	return NAllocations;
+}
+
+void AllocationCounter::checkSteadyCook(const char* nodePath, uint64_t nAllocations)
+{
+	if (nAllocations == 0)
+		return;
+
+	char message[512];
+
+	snprintf(message, sizeof(message), "%s: %llu allocations in steady cook\n",
+		nodePath, (unsigned long long)nAllocations);
+#ifdef _WIN32
+	OutputDebugStringA(message);
+#else
+	fputs(message, stderr);
+#endif
+
+	assert(nAllocations == 0 && "cook path allocates in steady state");
+}
+
+#else
+
+bool AllocationCounter::isEnabled()
+{
+	return false;
+}
+
+uint64_t AllocationCounter::get()
+{
+	return 0;
+}
+
+void AllocationCounter::checkSteadyCook(const char* nodePath, uint64_t nAllocations)
+{
+}
+
+#endif
@@ -0,0 +1,79 @@
+//
+//	allocation_counter.h is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#ifndef __allocation_counter_h__
+#define __allocation_counter_h__
+
+#include <cstdint>
+
+/*
+Counts heap allocations made by the calling thread, so that cook paths can
+be checked for not allocating in steady state. Counting replaces global
+operator new of this DLL and is compiled in only when YT_COUNT_ALLOCATIONS
+is defined (AllocCheck configurations); otherwise counter stays at zero.
+*/
+class AllocationCounter {
+public:
+	static bool isEnabled();
+	// allocations made by calling thread so far
+	static uint64_t get();
+	// logs and asserts that a steady cook of the node didn't allocate
+	static void checkSteadyCook(const char* nodePath, uint64_t nAllocations);
+};
+
+/*
+Allocations of one cook of a node, from the start of getGeneralInfo() to the
+end of execute(). Cook is steady if node was settled at both ends; once node
+stays settled for SteadyCooksToCheck cooks, every allocating cook is reported.
+*/
+class CookAllocations {
+public:
+	static const unsigned SteadyCooksToCheck = 30;
+
+	CookAllocations() : start_(0), nAllocations_(0), nSteadyCooks_(0), isSteadyStart_(false) {}
+
+	void begin(bool isSteady)
+	{
+		start_ = AllocationCounter::get();
+		isSteadyStart_ = isSteady;
+	}
+
+	void end(bool isSteady, const char* nodePath)
+	{
+		nAllocations_ = AllocationCounter::get() - start_;
+
+		if (!isSteadyStart_ || !isSteady)
+			nSteadyCooks_ = 0;
+		else if (++nSteadyCooks_ > SteadyCooksToCheck && nAllocations_ != 0)
+		{
+			AllocationCounter::checkSteadyCook(nodePath, nAllocations_);
+			nSteadyCooks_ = 0;
+		}
+	}
+
+	uint64_t get() const { return nAllocations_; }
+
+private:
+	uint64_t start_, nAllocations_;
+	unsigned nSteadyCooks_;
+	bool isSteadyStart_;
+};
+
+#endif
@@ -0,0 +1,177 @@
+//
+//	audio_kernels.cpp is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#include "audio_kernels.h"
+
+#include <string.h>
+
+// SSE2 is part of x64 baseline, no runtime dispatch needed
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define AUDIO_KERNELS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+	void deinterleaveScalar(const int16_t* src, size_t nFrames, unsigned nChannels,
+		float* const* dst, unsigned nOutChannels, float scale, size_t start)
+	{
+		for (size_t i = start; i < nFrames; ++i)
+			for (unsigned j = 0; j < nOutChannels; ++j)
+				dst[j][i] = (float)src[i*nChannels + j] * scale;
+	}
+
+	void deinterleaveScalar(const float* src, size_t nFrames, unsigned nChannels,
+		float* const* dst, unsigned nOutChannels, size_t start)
+	{
+		for (size_t i = start; i < nFrames; ++i)
+			for (unsigned j = 0; j < nOutChannels; ++j)
+				dst[j][i] = src[i*nChannels + j];
+	}
+
+#ifdef AUDIO_KERNELS_SSE2
+	// sign-extends 8 int16 samples into two vectors of 4 floats
+	inline void convert8(const int16_t* src, __m128 scale, __m128& lo, __m128& hi)
+	{
+		__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+		lo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16)), scale);
+		hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16)), scale);
+	}
+
+	// returns number of frames converted
+	size_t deinterleaveMono(const int16_t* src, size_t nFrames, float* dst, float scale)
+	{
+		__m128 s = _mm_set1_ps(scale), lo, hi;
+		size_t i = 0;
+
+		for (; i + 8 <= nFrames; i += 8)
+		{
+			convert8(src + i, s, lo, hi);
+			_mm_storeu_ps(dst + i, lo);
+			_mm_storeu_ps(dst + i + 4, hi);
+		}
+
+		return i;
+	}
+
+	size_t deinterleaveStereo(const int16_t* src, size_t nFrames, float* left, float* right,
+		float scale)
+	{
+		__m128 s = _mm_set1_ps(scale), lo, hi;
+		size_t i = 0;
+
+		for (; i + 4 <= nFrames; i += 4)
+		{
+			// lo = L0 R0 L1 R1, hi = L2 R2 L3 R3
+			convert8(src + 2*i, s, lo, hi);
+			_mm_storeu_ps(left + i, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+
+			if (right)
+				_mm_storeu_ps(right + i, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+
+		return i;
+	}
+
+	size_t deinterleaveStereo(const float* src, size_t nFrames, float* left, float* right)
+	{
+		size_t i = 0;
+
+		for (; i + 4 <= nFrames; i += 4)
+		{
+			__m128 lo = _mm_loadu_ps(src + 2*i), hi = _mm_loadu_ps(src + 2*i + 4);
+			_mm_storeu_ps(left + i, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+
+			if (right)
+				_mm_storeu_ps(right + i, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+
+		return i;
+	}
+#endif
+}
+
+void audio::deinterleave(const int16_t* src, size_t nFrames, unsigned nChannels,
+	float* const* dst, unsigned nOutChannels, float scale)
+{
+	size_t done = 0;
+
+	if (nOutChannels > nChannels)
+		nOutChannels = nChannels;
+
+	if (nOutChannels == 0)
+		return;
+
+#ifdef AUDIO_KERNELS_SSE2
+	if (nChannels == 1)
+		done = deinterleaveMono(src, nFrames, dst[0], scale);
+	else if (nChannels == 2)
+		done = deinterleaveStereo(src, nFrames, dst[0], (nOutChannels > 1 ? dst[1] : nullptr), scale);
+#endif
+
+	deinterleaveScalar(src, nFrames, nChannels, dst, nOutChannels, scale, done);
+}
+
+void audio::deinterleave(const float* src, size_t nFrames, unsigned nChannels,
+	float* const* dst, unsigned nOutChannels)
+{
+	size_t done = 0;
+
+	if (nOutChannels > nChannels)
+		nOutChannels = nChannels;
+
+	if (nOutChannels == 0)
+		return;
+
+	if (nChannels == 1)
+	{
+		memcpy(dst[0], src, nFrames * sizeof(float));
+		return;
+	}
+
+#ifdef AUDIO_KERNELS_SSE2
+	if (nChannels == 2)
+		done = deinterleaveStereo(src, nFrames, dst[0], (nOutChannels > 1 ? dst[1] : nullptr));
+#endif
+
+	deinterleaveScalar(src, nFrames, nChannels, dst, nOutChannels, done);
+}
+
+float audio::dot(const float* a, const float* b, size_t n)
+{
+	float sum = 0;
+	size_t i = 0;
+
+#ifdef AUDIO_KERNELS_SSE2
+	__m128 acc = _mm_setzero_ps();
+
+	for (; i + 4 <= n; i += 4)
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+
+	// horizontal add
+	acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+	acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(1, 1, 1, 1)));
+	sum = _mm_cvtss_f32(acc);
+#endif
+
+	for (; i < n; ++i)
+		sum += a[i] * b[i];
+
+	return sum;
+}
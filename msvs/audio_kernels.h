@@ -0,0 +1,54 @@
+//
+//	audio_kernels.h is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#ifndef __audio_kernels_h__
+#define __audio_kernels_h__
+
+#include <cstddef>
+#include <cstdint>
+
+namespace audio {
+	/**
+	 * Converts nFrames frames of interleaved signed 16-bit samples into
+	 * float planes, multiplying each sample by scale. Only first
+	 * nOutChannels channels are written, dst[i] receives nFrames samples.
+	 * Mono and stereo are vectorized where SSE2 is available.
+	 */
+	void deinterleave(const int16_t* src, size_t nFrames, unsigned nChannels,
+		float* const* dst, unsigned nOutChannels, float scale);
+
+	/**
+	 * Same for interleaved float samples, no scaling is applied. Mono is a
+	 * plain copy.
+	 */
+	void deinterleave(const float* src, size_t nFrames, unsigned nChannels,
+		float* const* dst, unsigned nOutChannels);
+
+	// sum of products of n pairs, used for FIR filtering
+	float dot(const float* a, const float* b, size_t n);
+
+	// converts n int16 samples to float, keeping their order
+	inline void convert(const int16_t* src, size_t n, float* dst, float scale)
+	{
+		deinterleave(src, n, 1, &dst, 1, scale);
+	}
+}
+
+#endif
@@ -0,0 +1,127 @@
+//
+//	audio_kernels_bench.cpp is part of YouTubeTOP
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+// Console microbenchmark of audio::deinterleave against the per-sample loop
+// YouTubeCHOP used before. Checks that both produce the same samples, then
+// prints time per frame of each. Exits with non-zero code on mismatch.
+
+#include "audio_kernels.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <climits>
+#include <cmath>
+#include <chrono>
+#include <vector>
+
+namespace {
+	// 48 kHz blocks, as VLC delivers them
+	const size_t BlockFrames = 4800;
+	const unsigned MaxChannels = 8;
+	const unsigned Passes = 2000;
+	const float Scale = 1.f / (float)SHRT_MAX;
+
+	// old YouTubeCHOP loop: frame and channel of every sample are computed
+	void deinterleaveReference(const int16_t* samples, size_t nSamples, size_t offset,
+		unsigned nChannels, float** channels, unsigned nOutChannels)
+	{
+		for (size_t k = 0; k < nSamples; k++)
+		{
+			size_t frame = (offset + k) / nChannels;
+			unsigned channel = (offset + k) % nChannels;
+
+			if (channel < nOutChannels)
+				channels[channel][frame] = ((float)samples[k] / (float)SHRT_MAX);
+		}
+	}
+
+	template<typename F>
+	double measure(F f)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		for (unsigned i = 0; i < Passes; ++i)
+			f();
+
+		std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+		return elapsed.count() / ((double)Passes * BlockFrames);
+	}
+
+	bool run(unsigned nChannels, const std::vector<int16_t>& src)
+	{
+		std::vector<float> expected(BlockFrames * nChannels), actual(BlockFrames * nChannels);
+		float* expectedPlanes[MaxChannels];
+		float* actualPlanes[MaxChannels];
+
+		for (unsigned j = 0; j < nChannels; ++j)
+		{
+			expectedPlanes[j] = &expected[j * BlockFrames];
+			actualPlanes[j] = &actual[j * BlockFrames];
+		}
+
+		deinterleaveReference(src.data(), BlockFrames * nChannels, 0, nChannels, expectedPlanes, nChannels);
+		audio::deinterleave(src.data(), BlockFrames, nChannels, actualPlanes, nChannels, Scale);
+
+		// multiplying by reciprocal may differ from division in the last bit
+		for (size_t i = 0; i < expected.size(); ++i)
+		{
+			if (fabs(expected[i] - actual[i]) > 1e-6f)
+			{
+				printf("%u channels: mismatch at %u (%f != %f)\n", nChannels, (unsigned)i,
+					expected[i], actual[i]);
+				return false;
+			}
+		}
+
+		double reference = measure([&](){
+			deinterleaveReference(src.data(), BlockFrames * nChannels, 0, nChannels, expectedPlanes, nChannels);
+		});
+		double kernel = measure([&](){
+			audio::deinterleave(src.data(), BlockFrames, nChannels, actualPlanes, nChannels, Scale);
+		});
+
+		printf("%u channels: reference %.3f ns/frame, kernel %.3f ns/frame, %.1fx\n",
+			nChannels, reference, kernel, reference / kernel);
+
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<int16_t> src(BlockFrames * MaxChannels);
+
+	srand(1);
+	for (auto& s : src)
+		s = (int16_t)(rand() % 65536 - 32768);
+
+	// extremes must survive sign extension
+	src[0] = SHRT_MIN;
+	src[1] = SHRT_MAX;
+
+	bool result = true;
+
+	for (unsigned nChannels = 1; nChannels <= MaxChannels; ++nChannels)
+		result = run(nChannels, src) && result;
+
+	return (result ? 0 : 1);
+}
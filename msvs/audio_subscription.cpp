@@ -0,0 +1,188 @@
+//
+//	audio_subscription.cpp is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+
+#include "audio_subscription.h"
+#include "audio_kernels.h"
+
+#include <string.h>
+#include <mutex>
+#include <algorithm>
+
+using namespace audio;
+
+namespace {
+	std::atomic<Block*> Chunks[BlockPool::MaxChunks];
+	std::atomic<unsigned> NChunks(0);
+	// where search for a free block starts next time
+	std::atomic<unsigned> NextBlock(0);
+	std::mutex ReserveMutex;
+	unsigned NReserved = 0;
+}
+
+void BlockPool::reserve(unsigned nBlocks)
+{
+	std::lock_guard<std::mutex> lock(ReserveMutex);
+	NReserved += nBlocks;
+
+	unsigned nChunks = NChunks.load(std::memory_order_relaxed);
+
+	while (nChunks * ChunkSize < NReserved && nChunks < MaxChunks)
+	{
+		Chunks[nChunks].store(new Block[ChunkSize], std::memory_order_relaxed);
+		// chunk is visible to acquire() only once it's stored
+		NChunks.store(++nChunks, std::memory_order_release);
+	}
+}
+
+void BlockPool::unreserve(unsigned nBlocks)
+{
+	std::lock_guard<std::mutex> lock(ReserveMutex);
+	NReserved -= std::min(nBlocks, NReserved);
+}
+
+BlockPtr BlockPool::acquire()
+{
+	unsigned nBlocks = NChunks.load(std::memory_order_acquire) * ChunkSize;
+	unsigned start = NextBlock.load(std::memory_order_relaxed);
+
+	for (unsigned i = 0; i < nBlocks; ++i)
+	{
+		unsigned idx = (start + i) % nBlocks;
+		Block& block = Chunks[idx / ChunkSize].load(std::memory_order_relaxed)[idx % ChunkSize];
+		int expected = 0;
+
+		if (block.refs_.load(std::memory_order_relaxed) == 0 &&
+			block.refs_.compare_exchange_strong(expected, 1, std::memory_order_acquire))
+		{
+			NextBlock.store(idx + 1, std::memory_order_relaxed);
+			return BlockPtr(&block);
+		}
+	}
+
+	return BlockPtr();
+}
+
+BlockPtr Block::make(const vlc::StreamController::AudioData& ad, unsigned offset, unsigned nSamples)
+{
+	BlockPtr ptr = BlockPool::acquire();
+
+	if (!ptr)
+		return ptr;
+
+	// the only reference is ours until it's pushed
+	Block* block = const_cast<Block*>(&*ptr);
+
+	if (nSamples > Capacity)
+		nSamples = Capacity;
+	block->rate_ = ad.audioInfo_.rate_;
+	block->channels_ = ad.audioInfo_.channels_;
+	block->delayUsec_ = ad.delayUsec_;
+	block->sourceFormat_ = ad.format_;
+	block->nSamples_ = nSamples;
+
+	if (ad.format_ == vlc::StreamController::FL32)
+		memcpy(block->samples_, static_cast<const float*>(ad.buffer_) + offset, nSamples * sizeof(float));
+	else
+		convert(static_cast<const vlc::StreamController::sample_type*>(ad.buffer_) + offset, nSamples,
+			block->samples_, 1.f / (float)vlc::StreamController::MaxSampleValue);
+
+	return ptr;
+}
+
+Subscription::Subscription() : overflows_(0), offset_(0), nAvailable_(0),
+	rate_(0), channels_(0), formatVersion_(0), delayUsec_(0), underflows_(0),
+	sourceFormat_(vlc::StreamController::S16)
+{
+	producing_.clear();
+	BlockPool::reserve(QueueCapacity);
+}
+
+Subscription::~Subscription()
+{
+	BlockPool::unreserve(QueueCapacity);
+}
+
+void Subscription::push(const BlockPtr& block)
+{
+	// queue takes one producer at a time; the other one drops its block
+	if (producing_.test_and_set(std::memory_order_acquire))
+	{
+		countOverflow();
+		return;
+	}
+
+	BlockPtr b(block);
+
+	if (!queue_.push(std::move(b)))
+		countOverflow();
+
+	producing_.clear(std::memory_order_release);
+}
+
+void Subscription::poll()
+{
+	BlockPtr block;
+
+	while (queue_.pop(block))
+	{
+		if (block->getRate() != rate_ || block->getChannels() != channels_)
+		{
+			clear();
+			rate_ = block->getRate();
+			channels_ = block->getChannels();
+			formatVersion_++;
+		}
+
+		delayUsec_ = block->getDelayUsec();
+		sourceFormat_ = block->getSourceFormat();
+		nAvailable_ += block->size();
+		blocks_.push_back(std::move(block));
+	}
+}
+
+void Subscription::consume(size_t n)
+{
+	if (n > nAvailable_)
+		n = nAvailable_;
+
+	nAvailable_ -= n;
+
+	while (n > 0)
+	{
+		size_t length = blocks_.front()->size() - offset_;
+
+		if (n < length)
+		{
+			offset_ += n;
+			break;
+		}
+
+		n -= length;
+		offset_ = 0;
+		blocks_.pop_front();
+	}
+}
+
+void Subscription::trim(size_t backlog)
+{
+	if (nAvailable_ > backlog)
+		consume(nAvailable_ - backlog);
+}
@@ -0,0 +1,243 @@
+//
+//	audio_subscription.h is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+
+#ifndef __audio_subscription_h__
+#define __audio_subscription_h__
+
+#include <memory>
+#include <deque>
+#include <atomic>
+#include <cstdint>
+
+#include "spsc_queue.h"
+#include "stream_controller.h"
+
+namespace audio {
+	class BlockPtr;
+
+	/**
+	 * Immutable block of interleaved float samples, shared by every
+	 * subscriber. Blocks live in a preallocated pool, so audio thread
+	 * neither allocates nor waits when it makes one.
+	 */
+	class Block {
+	public:
+		// samples one block holds; longer VLC buffers are split
+		static const unsigned Capacity = 2048;
+
+		/**
+		 * Copies up to Capacity samples starting at offset out of VLC's 
+		 * buffer, converting them to float. Returns empty pointer when 
+		 * the pool is exhausted.
+		 */
+		static BlockPtr make(const vlc::StreamController::AudioData& ad, unsigned offset, unsigned nSamples);
+
+		unsigned getRate() const { return rate_; }
+		unsigned getChannels() const { return channels_; }
+		uint64_t getDelayUsec() const { return delayUsec_; }
+		// format VLC delivered samples in
+		vlc::StreamController::SampleFormat getSourceFormat() const { return sourceFormat_; }
+		size_t size() const { return nSamples_; }
+		const float* samples() const { return samples_; }
+
+	private:
+		friend class BlockPtr;
+		friend class BlockPool;
+
+		Block() : refs_(0) {}
+		Block(const Block&) = delete;
+		Block& operator=(const Block&) = delete;
+
+		// zero means block is free
+		std::atomic<int> refs_;
+		unsigned rate_, channels_;
+		uint64_t delayUsec_;
+		vlc::StreamController::SampleFormat sourceFormat_;
+		size_t nSamples_;
+		float samples_[Capacity];
+	};
+
+	/**
+	 * Reference to a pooled block. Block goes back to the pool when the
+	 * last reference is gone.
+	 */
+	class BlockPtr {
+	public:
+		BlockPtr() : block_(nullptr) {}
+		BlockPtr(const BlockPtr& other) : block_(other.block_) { addRef(); }
+		BlockPtr(BlockPtr&& other) : block_(other.block_) { other.block_ = nullptr; }
+		~BlockPtr() { reset(); }
+
+		BlockPtr& operator=(const BlockPtr& other)
+		{
+			if (this != &other)
+			{
+				other.addRef();
+				reset();
+				block_ = other.block_;
+			}
+			return *this;
+		}
+
+		BlockPtr& operator=(BlockPtr&& other)
+		{
+			if (this != &other)
+			{
+				reset();
+				block_ = other.block_;
+				other.block_ = nullptr;
+			}
+			return *this;
+		}
+
+		explicit operator bool() const { return block_ != nullptr; }
+		const Block* operator->() const { return block_; }
+		const Block& operator*() const { return *block_; }
+
+		void reset()
+		{
+			if (block_)
+				block_->refs_.fetch_sub(1, std::memory_order_acq_rel);
+			block_ = nullptr;
+		}
+
+	private:
+		friend class BlockPool;
+		// takes over reference already counted by the pool
+		explicit BlockPtr(Block* block) : block_(block) {}
+
+		void addRef() const
+		{
+			if (block_)
+				block_->refs_.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		Block* block_;
+	};
+
+	/*
+	Process-wide pool of audio blocks. Grows on consumer's thread when 
+	subscriptions reserve blocks and never shrinks until DLL is unloaded,
+	so blocks may outlive their subscribers and producers.
+	*/
+	class BlockPool {
+	public:
+		// blocks are allocated in chunks of this many
+		static const unsigned ChunkSize = 64;
+		static const unsigned MaxChunks = 256;
+
+		// not for audio thread - may allocate
+		static void reserve(unsigned nBlocks);
+		static void unreserve(unsigned nBlocks);
+
+		// lock-free. empty pointer if every block is in use
+		static BlockPtr acquire();
+	};
+
+	/*
+	Read cursor of one audio consumer over a stream of shared blocks. Blocks
+	are handed over from audio thread through a lock-free queue; producer
+	never waits, when consumer falls behind (or pool runs out of blocks) 
+	blocks are dropped and counted as overflow. Subscription reserves 
+	enough pooled blocks to fill its queue. Subscription may briefly be fed
+	by two TOPs (CHOP rebinding to another TOP, or follower joining or
+	leaving its leader while audio thread still holds the old subscriber 
+	list), so producers are serialized with a token: push from the second
+	one is dropped and counted as overflow. Everything else is consumer 
+	side and must be called from one thread.
+	*/
+	class Subscription {
+	public:
+		static const size_t QueueCapacity = 256;
+
+		Subscription();
+		~Subscription();
+
+		// producer side
+		void push(const BlockPtr& block);
+		void countOverflow() { overflows_.fetch_add(1, std::memory_order_relaxed); }
+
+		// picks up blocks pushed so far. if stream format changed, samples
+		// in old format are discarded
+		void poll();
+
+		// number of samples polled and not consumed yet
+		size_t available() const { return nAvailable_; }
+		// calls f(const float* samples, size_t length) for consecutive
+		// pieces of the next n samples. false if less than n available
+		template<typename F>
+		bool peek(size_t n, F f) const;
+		void consume(size_t n);
+		// drops oldest samples so that no more than backlog samples are left
+		void trim(size_t backlog);
+		void clear() { trim(0); }
+
+		// format of the latest polled block
+		unsigned getRate() const { return rate_; }
+		unsigned getChannels() const { return channels_; }
+		uint64_t getDelayUsec() const { return delayUsec_; }
+		vlc::StreamController::SampleFormat getSourceFormat() const { return sourceFormat_; }
+		// incremented whenever rate or number of channels change
+		unsigned getFormatVersion() const { return formatVersion_; }
+
+		void countUnderflow() { underflows_++; }
+		uint64_t getOverflows() const { return overflows_.load(std::memory_order_relaxed); }
+		uint64_t getUnderflows() const { return underflows_; }
+
+	private:
+		SpscQueue<BlockPtr, QueueCapacity> queue_;
+		// held by the producer pushing right now
+		std::atomic_flag producing_;
+		std::atomic<uint64_t> overflows_;
+
+		// consumer-owned
+		std::deque<BlockPtr> blocks_;
+		// read position in the front block
+		size_t offset_, nAvailable_;
+		unsigned rate_, channels_, formatVersion_;
+		uint64_t delayUsec_, underflows_;
+		vlc::StreamController::SampleFormat sourceFormat_;
+	};
+
+	template<typename F>
+	bool Subscription::peek(size_t n, F f) const
+	{
+		if (n > nAvailable_)
+			return false;
+
+		size_t offset = offset_;
+
+		for (auto it = blocks_.begin(); n > 0; ++it, offset = 0)
+		{
+			size_t length = (*it)->size() - offset;
+
+			if (length > n)
+				length = n;
+
+			f((*it)->samples() + offset, length);
+			n -= length;
+		}
+
+		return true;
+	}
+}
+
+#endif
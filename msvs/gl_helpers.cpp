@@ -0,0 +1,234 @@
+//
+//	gl_helpers.cpp is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#include "gl_helpers.h"
+
+#include <string.h>
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <EGL/egl.h>
+#endif
+
+namespace gl {
+	PFNGenBuffers GenBuffers = nullptr;
+	PFNDeleteBuffers DeleteBuffers = nullptr;
+	PFNBindBuffer BindBuffer = nullptr;
+	PFNBufferData BufferData = nullptr;
+	PFNBufferStorage BufferStorage = nullptr;
+	PFNMapBufferRange MapBufferRange = nullptr;
+	PFNUnmapBuffer UnmapBuffer = nullptr;
+	PFNFenceSync FenceSync = nullptr;
+	PFNClientWaitSync ClientWaitSync = nullptr;
+	PFNDeleteSync DeleteSync = nullptr;
+	PFNActiveTexture ActiveTexture = nullptr;
+	PFNCreateShader CreateShader = nullptr;
+	PFNDeleteShader DeleteShader = nullptr;
+	PFNShaderSource ShaderSource = nullptr;
+	PFNCompileShader CompileShader = nullptr;
+	PFNGetShaderiv GetShaderiv = nullptr;
+	PFNGetShaderInfoLog GetShaderInfoLog = nullptr;
+	PFNCreateProgram CreateProgram = nullptr;
+	PFNDeleteProgram DeleteProgram = nullptr;
+	PFNAttachShader AttachShader = nullptr;
+	PFNLinkProgram LinkProgram = nullptr;
+	PFNGetProgramiv GetProgramiv = nullptr;
+	PFNGetProgramInfoLog GetProgramInfoLog = nullptr;
+	PFNUseProgram UseProgram = nullptr;
+	PFNGetUniformLocation GetUniformLocation = nullptr;
+	PFNUniform1i Uniform1i = nullptr;
+	PFNUniform1f Uniform1f = nullptr;
+
+	namespace {
+		static bool extensionsLoaded = false;
+
+		void* getProc(const char* name)
+		{
+#ifdef _WIN32
+			void* proc = (void*)wglGetProcAddress(name);
+
+			// wglGetProcAddress may return these instead of NULL
+			if (proc == (void*)1 || proc == (void*)2 || proc == (void*)3 || proc == (void*)-1)
+				return nullptr;
+
+			return proc;
+#else
+			return (void*)eglGetProcAddress(name);
+#endif
+		}
+
+		template<typename T>
+		void load(T& fn, const char* name, const char* altName = nullptr)
+		{
+			fn = reinterpret_cast<T>(getProc(name));
+
+			if (!fn && altName)
+				fn = reinterpret_cast<T>(getProc(altName));
+		}
+	}
+
+	void loadExtensions()
+	{
+		if (extensionsLoaded || !hasCurrentContext())
+			return;
+
+		load(GenBuffers, "glGenBuffers", "glGenBuffersARB");
+		load(DeleteBuffers, "glDeleteBuffers", "glDeleteBuffersARB");
+		load(BindBuffer, "glBindBuffer", "glBindBufferARB");
+		load(BufferData, "glBufferData", "glBufferDataARB");
+		load(BufferStorage, "glBufferStorage");
+		load(MapBufferRange, "glMapBufferRange");
+		load(UnmapBuffer, "glUnmapBuffer", "glUnmapBufferARB");
+		load(FenceSync, "glFenceSync");
+		load(ClientWaitSync, "glClientWaitSync");
+		load(DeleteSync, "glDeleteSync");
+		load(ActiveTexture, "glActiveTexture", "glActiveTextureARB");
+		load(CreateShader, "glCreateShader");
+		load(DeleteShader, "glDeleteShader");
+		load(ShaderSource, "glShaderSource");
+		load(CompileShader, "glCompileShader");
+		load(GetShaderiv, "glGetShaderiv");
+		load(GetShaderInfoLog, "glGetShaderInfoLog");
+		load(CreateProgram, "glCreateProgram");
+		load(DeleteProgram, "glDeleteProgram");
+		load(AttachShader, "glAttachShader");
+		load(LinkProgram, "glLinkProgram");
+		load(GetProgramiv, "glGetProgramiv");
+		load(GetProgramInfoLog, "glGetProgramInfoLog");
+		load(UseProgram, "glUseProgram");
+		load(GetUniformLocation, "glGetUniformLocation");
+		load(Uniform1i, "glUniform1i");
+		load(Uniform1f, "glUniform1f");
+
+		extensionsLoaded = true;
+	}
+
+	bool hasCurrentContext()
+	{
+#ifdef _WIN32
+		return (wglGetCurrentContext() != NULL);
+#else
+		return (eglGetCurrentContext() != EGL_NO_CONTEXT);
+#endif
+	}
+
+	bool hasExtension(const char* name)
+	{
+		const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+
+		if (!extensions)
+			return false;
+
+		size_t len = strlen(name);
+		const char* pos = extensions;
+
+		// make sure we don't match a prefix of a longer extension name
+		while ((pos = strstr(pos, name)) != nullptr)
+		{
+			if ((pos == extensions || pos[-1] == ' ') &&
+				(pos[len] == ' ' || pos[len] == '\0'))
+				return true;
+
+			pos += len;
+		}
+
+		return false;
+	}
+
+	bool isVersionAtLeast(int major, int minor)
+	{
+		const char* version = (const char*)glGetString(GL_VERSION);
+		int glMajor = 0, glMinor = 0;
+
+		if (!version || sscanf(version, "%d.%d", &glMajor, &glMinor) != 2)
+			return false;
+
+		return (glMajor > major || (glMajor == major && glMinor >= minor));
+	}
+
+	bool hasPixelBuffers()
+	{
+		return GenBuffers && DeleteBuffers && BindBuffer && BufferData &&
+			MapBufferRange && UnmapBuffer &&
+			(isVersionAtLeast(3, 0) ||
+			(hasExtension("GL_ARB_pixel_buffer_object") && hasExtension("GL_ARB_map_buffer_range")));
+	}
+
+	bool hasPersistentBuffers()
+	{
+		return hasPixelBuffers() && BufferStorage &&
+			FenceSync && ClientWaitSync && DeleteSync &&
+			(isVersionAtLeast(4, 4) || hasExtension("GL_ARB_buffer_storage"));
+	}
+
+	bool hasShaders()
+	{
+		return ActiveTexture && CreateShader && DeleteShader && ShaderSource &&
+			CompileShader && GetShaderiv && GetShaderInfoLog && CreateProgram &&
+			DeleteProgram && AttachShader && LinkProgram && GetProgramiv && 
+			GetProgramInfoLog && UseProgram && GetUniformLocation && 
+			Uniform1i && Uniform1f && isVersionAtLeast(2, 0);
+	}
+
+	GLuint compileProgram(const char* fragmentSource, std::string& errorLog)
+	{
+		if (!hasShaders())
+		{
+			errorLog = "shaders are not supported";
+			return 0;
+		}
+
+		GLint status = 0, logLength = 0;
+		GLuint shader = CreateShader(GL_FRAGMENT_SHADER);
+
+		ShaderSource(shader, 1, &fragmentSource, NULL);
+		CompileShader(shader);
+		GetShaderiv(shader, GL_COMPILE_STATUS, &status);
+
+		if (!status)
+		{
+			GetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLength);
+			errorLog.resize(logLength > 0 ? logLength : 0);
+			if (logLength > 0)
+				GetShaderInfoLog(shader, logLength, NULL, &errorLog[0]);
+			DeleteShader(shader);
+			return 0;
+		}
+
+		GLuint program = CreateProgram();
+		AttachShader(program, shader);
+		LinkProgram(program);
+		// shader is deleted together with the program
+		DeleteShader(shader);
+		GetProgramiv(program, GL_LINK_STATUS, &status);
+
+		if (!status)
+		{
+			GetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+			errorLog.resize(logLength > 0 ? logLength : 0);
+			if (logLength > 0)
+				GetProgramInfoLog(program, logLength, NULL, &errorLog[0]);
+			DeleteProgram(program);
+			return 0;
+		}
+
+		return program;
+	}
+}
@@ -0,0 +1,199 @@
+//
+//	gl_helpers.h is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#ifndef __gl_helpers_h__
+#define __gl_helpers_h__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <gl/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+/*
+Windows' gl.h stops at OpenGL 1.1, so everything newer is declared here and
+loaded at runtime. Function pointers live in gl:: namespace in order not to
+clash with prototypes from glext.h on platforms that provide them.
+*/
+
+#ifndef GL_VERSION_1_5
+typedef ptrdiff_t GLsizeiptr;
+typedef ptrdiff_t GLintptr;
+#endif
+
+#ifndef GL_VERSION_2_0
+typedef char GLchar;
+#endif
+
+#ifndef GL_VERSION_3_2
+typedef struct __GLsync *GLsync;
+typedef uint64_t GLuint64;
+#endif
+
+#ifndef GL_STREAM_DRAW
+#define GL_STREAM_DRAW						0x88E0
+#endif
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER				0x88EC
+#endif
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT					0x0002
+#endif
+#ifndef GL_MAP_INVALIDATE_BUFFER_BIT
+#define GL_MAP_INVALIDATE_BUFFER_BIT		0x0008
+#endif
+#ifndef GL_MAP_UNSYNCHRONIZED_BIT
+#define GL_MAP_UNSYNCHRONIZED_BIT			0x0020
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT				0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT					0x0080
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE		0x9117
+#endif
+#ifndef GL_ALREADY_SIGNALED
+#define GL_ALREADY_SIGNALED					0x911A
+#endif
+#ifndef GL_TIMEOUT_EXPIRED
+#define GL_TIMEOUT_EXPIRED					0x911B
+#endif
+#ifndef GL_CONDITION_SATISFIED
+#define GL_CONDITION_SATISFIED				0x911C
+#endif
+#ifndef GL_WAIT_FAILED
+#define GL_WAIT_FAILED						0x911D
+#endif
+#ifndef GL_SYNC_FLUSH_COMMANDS_BIT
+#define GL_SYNC_FLUSH_COMMANDS_BIT			0x00000001
+#endif
+#ifndef GL_TEXTURE0
+#define GL_TEXTURE0							0x84C0
+#endif
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE					0x812F
+#endif
+#ifndef GL_FRAGMENT_SHADER
+#define GL_FRAGMENT_SHADER					0x8B30
+#endif
+#ifndef GL_COMPILE_STATUS
+#define GL_COMPILE_STATUS					0x8B81
+#endif
+#ifndef GL_LINK_STATUS
+#define GL_LINK_STATUS						0x8B82
+#endif
+#ifndef GL_INFO_LOG_LENGTH
+#define GL_INFO_LOG_LENGTH					0x8B84
+#endif
+
+namespace gl {
+	typedef void (APIENTRY *PFNGenBuffers)(GLsizei n, GLuint *buffers);
+	typedef void (APIENTRY *PFNDeleteBuffers)(GLsizei n, const GLuint *buffers);
+	typedef void (APIENTRY *PFNBindBuffer)(GLenum target, GLuint buffer);
+	typedef void (APIENTRY *PFNBufferData)(GLenum target, GLsizeiptr size, const void *data, GLenum usage);
+	typedef void (APIENTRY *PFNBufferStorage)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+	typedef void* (APIENTRY *PFNMapBufferRange)(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+	typedef GLboolean (APIENTRY *PFNUnmapBuffer)(GLenum target);
+	typedef GLsync (APIENTRY *PFNFenceSync)(GLenum condition, GLbitfield flags);
+	typedef GLenum (APIENTRY *PFNClientWaitSync)(GLsync sync, GLbitfield flags, GLuint64 timeout);
+	typedef void (APIENTRY *PFNDeleteSync)(GLsync sync);
+	typedef void (APIENTRY *PFNActiveTexture)(GLenum texture);
+	typedef GLuint (APIENTRY *PFNCreateShader)(GLenum type);
+	typedef void (APIENTRY *PFNDeleteShader)(GLuint shader);
+	typedef void (APIENTRY *PFNShaderSource)(GLuint shader, GLsizei count, const GLchar *const*string, const GLint *length);
+	typedef void (APIENTRY *PFNCompileShader)(GLuint shader);
+	typedef void (APIENTRY *PFNGetShaderiv)(GLuint shader, GLenum pname, GLint *params);
+	typedef void (APIENTRY *PFNGetShaderInfoLog)(GLuint shader, GLsizei bufSize, GLsizei *length, GLchar *infoLog);
+	typedef GLuint (APIENTRY *PFNCreateProgram)(void);
+	typedef void (APIENTRY *PFNDeleteProgram)(GLuint program);
+	typedef void (APIENTRY *PFNAttachShader)(GLuint program, GLuint shader);
+	typedef void (APIENTRY *PFNLinkProgram)(GLuint program);
+	typedef void (APIENTRY *PFNGetProgramiv)(GLuint program, GLenum pname, GLint *params);
+	typedef void (APIENTRY *PFNGetProgramInfoLog)(GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog);
+	typedef void (APIENTRY *PFNUseProgram)(GLuint program);
+	typedef GLint (APIENTRY *PFNGetUniformLocation)(GLuint program, const GLchar *name);
+	typedef void (APIENTRY *PFNUniform1i)(GLint location, GLint v0);
+	typedef void (APIENTRY *PFNUniform1f)(GLint location, GLfloat v0);
+
+	extern PFNGenBuffers GenBuffers;
+	extern PFNDeleteBuffers DeleteBuffers;
+	extern PFNBindBuffer BindBuffer;
+	extern PFNBufferData BufferData;
+	extern PFNBufferStorage BufferStorage;
+	extern PFNMapBufferRange MapBufferRange;
+	extern PFNUnmapBuffer UnmapBuffer;
+	extern PFNFenceSync FenceSync;
+	extern PFNClientWaitSync ClientWaitSync;
+	extern PFNDeleteSync DeleteSync;
+	extern PFNActiveTexture ActiveTexture;
+	extern PFNCreateShader CreateShader;
+	extern PFNDeleteShader DeleteShader;
+	extern PFNShaderSource ShaderSource;
+	extern PFNCompileShader CompileShader;
+	extern PFNGetShaderiv GetShaderiv;
+	extern PFNGetShaderInfoLog GetShaderInfoLog;
+	extern PFNCreateProgram CreateProgram;
+	extern PFNDeleteProgram DeleteProgram;
+	extern PFNAttachShader AttachShader;
+	extern PFNLinkProgram LinkProgram;
+	extern PFNGetProgramiv GetProgramiv;
+	extern PFNGetProgramInfoLog GetProgramInfoLog;
+	extern PFNUseProgram UseProgram;
+	extern PFNGetUniformLocation GetUniformLocation;
+	extern PFNUniform1i Uniform1i;
+	extern PFNUniform1f Uniform1f;
+
+	/**
+	 * Loads extension entry points. Must be called with GL context
+	 * being current. Safe to call multiple times - loads only once.
+	 */
+	void loadExtensions();
+
+	bool hasCurrentContext();
+	bool hasExtension(const char* name);
+	bool isVersionAtLeast(int major, int minor);
+
+	// pixel buffer objects with ranged mapping (GL 3.0 or ARB_map_buffer_range)
+	bool hasPixelBuffers();
+	// persistently mapped buffers (GL 4.4 or ARB_buffer_storage) with fences
+	bool hasPersistentBuffers();
+	// GLSL programs and multitexturing (GL 2.0)
+	bool hasShaders();
+
+	/**
+	 * Compiles and links program consisting of a single fragment shader 
+	 * (vertex processing stays fixed-function). Returns 0 on failure, 
+	 * errors are written into errorLog.
+	 */
+	GLuint compileProgram(const char* fragmentSource, std::string& errorLog);
+}
+
+#endif
@@ -0,0 +1,176 @@
+//
+//	instance_pool.cpp is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#include "instance_pool.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+using namespace std;
+using namespace vlc;
+
+typedef lock_guard<mutex> ScopedLock;
+
+namespace {
+	struct LogListenerEntry {
+		// VLC object whose messages listener gets
+		uintptr_t objectId_;
+		InstancePool::LogListener listener_;
+		void* data_;
+	};
+
+	struct PooledInstance {
+		libvlc_instance_t* instance_ = nullptr;
+		unsigned nUsers_ = 0;
+		vector<LogListenerEntry> listeners_;
+	};
+
+	static PooledInstance Pool[InstancePool::PoolSize];
+	// guards instances' lifetime
+	static mutex PoolAccess;
+	// guards log listeners
+	static mutex ListenersAccess;
+
+	void logCallback(void *data, int level, const libvlc_log_t *ctx, const char *fmt, va_list args)
+	{
+		if (level <= LIBVLC_DEBUG)
+			return;
+
+		PooledInstance* p = reinterpret_cast<PooledInstance*>(data);
+		const char *name, *header;
+		uintptr_t objectId = 0;
+
+		libvlc_log_get_object(ctx, &name, &header, &objectId);
+
+		ScopedLock lock(ListenersAccess);
+		auto it = find_if(p->listeners_.begin(), p->listeners_.end(),
+			[objectId](const LogListenerEntry& l){ return l.objectId_ == objectId; });
+
+		// instance is shared - other players' messages aren't formatted at all
+		if (it == p->listeners_.end())
+			return;
+
+		char buf[4096];
+
+		vsnprintf(buf, sizeof(buf), fmt, args);
+		buf[sizeof(buf) - 1] = '\0';
+		it->listener_(it->data_, level, buf);
+	}
+
+	// must be called with PoolAccess locked
+	void createInstances()
+	{
+		static const int nArgs = 1;
+		static const char *libVlcArgs[nArgs] = { "--network-caching=20000" };
+
+		for (auto& p : Pool)
+		{
+			if (!p.instance_)
+			{
+				p.instance_ = libvlc_new(nArgs, libVlcArgs);
+
+				if (p.instance_)
+					libvlc_log_set(p.instance_, &logCallback, &p);
+			}
+		}
+
+#ifdef _WIN32
+		// instances are never released (see InstancePool), so VLC's threads
+		// must not outlive its code when our DLL is unloaded
+		static bool isPinned = false;
+		HMODULE module;
+
+		if (!isPinned && Pool[0].instance_)
+		{
+			GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_PIN, "libvlc.dll", &module);
+			GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_PIN, "libvlccore.dll", &module);
+			isPinned = true;
+		}
+#endif
+	}
+}
+
+void InstancePool::warmUp()
+{
+	ScopedLock lock(PoolAccess);
+	createInstances();
+}
+
+libvlc_instance_t* InstancePool::acquire()
+{
+	ScopedLock lock(PoolAccess);
+	createInstances();
+
+	PooledInstance* best = nullptr;
+
+	for (auto& p : Pool)
+		if (p.instance_ && (!best || p.nUsers_ < best->nUsers_))
+			best = &p;
+
+	if (!best)
+		return nullptr;
+
+	best->nUsers_++;
+
+	return best->instance_;
+}
+
+void InstancePool::listen(libvlc_instance_t* instance, const void* object, 
+	LogListener listener, void* data)
+{
+	ScopedLock lock(PoolAccess);
+
+	for (auto& p : Pool)
+	{
+		if (p.instance_ == instance)
+		{
+			ScopedLock listenersLock(ListenersAccess);
+			p.listeners_.push_back({ (uintptr_t)object, listener, data });
+		}
+	}
+}
+
+void InstancePool::release(libvlc_instance_t* instance, void* data)
+{
+	ScopedLock lock(PoolAccess);
+
+	for (auto& p : Pool)
+	{
+		if (p.instance_ == instance && p.nUsers_)
+		{
+			ScopedLock listenersLock(ListenersAccess);
+
+			p.nUsers_--;
+			p.listeners_.erase(remove_if(p.listeners_.begin(), p.listeners_.end(),
+				[data](const LogListenerEntry& l){ return l.data_ == data; }),
+				p.listeners_.end());
+		}
+	}
+
+	// instance is kept even if nobody uses it - next controller won't
+	// have to wait for libvlc_new()
+}
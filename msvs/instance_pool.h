@@ -0,0 +1,70 @@
+//
+//	instance_pool.h is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#ifndef __instance_pool_h__
+#define __instance_pool_h__
+
+#include <vlc/vlc.h>
+
+namespace vlc {
+	/*
+	Thread-safe process-wide pool of libvlc instances. Creating an instance
+	loads plugins and spawns VLC's own threads, so instead of doing it for
+	every StreamController, controllers create their players against one of
+	the few shared instances. Instances are created by warmUp() (or by the
+	first acquire()) and leaked on purpose, so that nodes created later 
+	don't pay for libvlc initialization again. libvlc_release() joins VLC's
+	threads and unloads its plugins, which can deadlock under the loader
+	lock in DllMain or static destructors, and there's no other point at
+	which DLL is known to be going away. libvlc modules are pinned instead,
+	so that VLC's threads keep running valid code after our DLL unloads.
+	*/
+	class InstancePool {
+	public:
+		// receives notices, warnings and errors logged by the instance
+		typedef void (*LogListener)(void* data, int level, const char* message);
+
+		static const unsigned PoolSize = 2;
+
+		/**
+		 * Creates pool instances unless they exist already. Must not be
+		 * called while DLL is being loaded (i.e. from static initializers).
+		 */
+		static void warmUp();
+
+		/**
+		 * Returns least loaded instance or nullptr if libvlc couldn't be
+		 * initialized.
+		 */
+		static libvlc_instance_t* acquire();
+
+		/**
+		 * Listener will get messages logged by given VLC object (i.e. 
+		 * player created against the instance) until release() is called 
+		 * with the same data pointer. Messages of other objects are not
+		 * passed to it.
+		 */
+		static void listen(libvlc_instance_t* instance, const void* object, 
+			LogListener listener, void* data);
+		static void release(libvlc_instance_t* instance, void* data);
+	};
+}
+
+#endif
@@ -0,0 +1,155 @@
+//
+//	loop_cache.cpp is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#include "loop_cache.h"
+
+#include <algorithm>
+#include <string.h>
+
+using namespace vlc;
+
+LoopCache::LoopCache()
+{
+	reset();
+}
+
+void LoopCache::reset()
+{
+	state_ = Idle;
+	url_ = "";
+	fps_ = 0;
+	chroma_ = StreamController::RGBA;
+	width_ = height_ = nPlanes_ = 0;
+	frameSize_ = size_ = 0;
+	frames_.clear();
+}
+
+void LoopCache::start(const std::string& url, double fps)
+{
+	reset();
+
+	if (fps <= 0)
+		return;
+
+	state_ = Recording;
+	url_ = url;
+	fps_ = fps;
+}
+
+bool LoopCache::record(const StreamController::FrameRef& frame)
+{
+	if (state_ != Recording || !frame)
+		return false;
+
+	if (frames_.empty())
+	{
+		chroma_ = frame.chroma();
+		width_ = frame.width();
+		height_ = frame.height();
+		nPlanes_ = frame.nPlanes();
+
+		for (unsigned i = 0; i < nPlanes_; ++i)
+		{
+			pitches_[i] = frame.pitch(i);
+			lines_[i] = frame.lines(i);
+			frameSize_ += pitches_[i] * lines_[i];
+		}
+	}
+
+	// same frame can be seen more than once
+	if (!frames_.empty() && frame.frameNo() == frames_.back().frameNo_)
+		return true;
+
+	bool isSameFormat = (frame.chroma() == chroma_ && frame.width() == width_ &&
+		frame.height() == height_ && frame.nPlanes() == nPlanes_);
+
+	for (unsigned i = 0; isSameFormat && i < nPlanes_; ++i)
+		isSameFormat = (frame.pitch(i) == pitches_[i] && frame.lines(i) == lines_[i]);
+
+	// frames come in decode order - anything else means playback was restarted
+	if (!isSameFormat || size_ + frameSize_ > MaxSize ||
+		(!frames_.empty() && frame.frameNo() <= frames_.back().frameNo_))
+	{
+		std::string url = url_;
+		reset();
+		url_ = url;
+		state_ = Failed;
+
+		return false;
+	}
+
+	Frame cached;
+	cached.frameNo_ = frame.frameNo();
+	cached.data_.reset(new unsigned char[frameSize_]);
+
+	unsigned char* plane = cached.data_.get();
+
+	for (unsigned i = 0; i < nPlanes_; ++i)
+	{
+		memcpy(plane, frame.plane(i), pitches_[i] * lines_[i]);
+		cached.planes_[i] = plane;
+		plane += pitches_[i] * lines_[i];
+	}
+
+	frames_.push_back(std::move(cached));
+	size_ += frameSize_;
+
+	return true;
+}
+
+void LoopCache::finish()
+{
+	if (state_ == Recording && !frames_.empty())
+		state_ = Ready;
+	else
+		reset();
+}
+
+unsigned LoopCache::getFrameIdx(int64_t timeMs) const
+{
+	int64_t duration = getDuration();
+
+	if (duration <= 0)
+		return 0;
+
+	timeMs %= duration;
+	if (timeMs < 0)
+		timeMs += duration;
+
+	// last frame which is due at this time
+	auto it = std::upper_bound(frames_.begin(), frames_.end(), timeMs,
+		[this](int64_t t, const Frame& f){ return t < getFrameTime(f); });
+
+	return (it == frames_.begin() ? 0 : (unsigned)(it - frames_.begin() - 1));
+}
+
+int64_t LoopCache::getDuration() const
+{
+	if (frames_.empty())
+		return 0;
+
+	// last frame stays on screen for one frame period
+	return getFrameTime(frames_.back()) + (int64_t)(1000. / fps_);
+}
+
+int64_t LoopCache::getFrameTime(const Frame& frame) const
+{
+	return (int64_t)((frame.frameNo_ - frames_.front().frameNo_) * 1000. / fps_);
+}
@@ -0,0 +1,105 @@
+//
+//	loop_cache.h is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#ifndef __loop_cache_h__
+#define __loop_cache_h__
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "stream_controller.h"
+
+/*
+Keeps decoded frames of one pass of a short loop in RAM as they are, so
+that later iterations are played from memory without any decoder work and
+without restarting players between iterations. Frames are timed by their
+decode number, so frames which the cook thread skipped don't shift the rest.
+Must be used from one thread.
+*/
+class LoopCache {
+public:
+	static const size_t MaxSize = (size_t)1 << 30;
+
+	typedef enum _State {
+		Idle,
+		Recording,
+		Ready,
+		Failed		// gave up on current URL
+	} State;
+
+	LoopCache();
+
+	void reset();
+
+	/**
+	 * Starts recording pass of URL which plays at given frame rate. 
+	 * Drops whatever was recorded before.
+	 */
+	void start(const std::string& url, double fps);
+
+	/**
+	 * Copies frame into cache. Fails (and frees memory) if frame format
+	 * changes or cache would grow over MaxSize.
+	 */
+	bool record(const vlc::StreamController::FrameRef& frame);
+
+	// closes the pass, cache is ready to be played from now on
+	void finish();
+
+	/**
+	 * Returns index of frame to show at given time since beginning of
+	 * pass. Time wraps around pass duration.
+	 */
+	unsigned getFrameIdx(int64_t timeMs) const;
+
+	const unsigned char* const* getPlanes(unsigned frameIdx) const { return frames_[frameIdx].planes_; }
+	const unsigned* getPitches() const { return pitches_; }
+
+	vlc::StreamController::Chroma getChroma() const { return chroma_; }
+	unsigned getWidth() const { return width_; }
+	unsigned getHeight() const { return height_; }
+	State getState() const { return state_; }
+	const std::string& getUrl() const { return url_; }
+	int64_t getDuration() const;
+	size_t getSize() const { return size_; }
+	size_t getNFrames() const { return frames_.size(); }
+
+private:
+	struct Frame {
+		uint64_t frameNo_;
+		std::unique_ptr<unsigned char[]> data_;
+		const unsigned char* planes_[vlc::StreamController::MaxPlanes];
+	};
+
+	State state_;
+	std::string url_;
+	double fps_;
+	vlc::StreamController::Chroma chroma_;
+	unsigned width_, height_, nPlanes_;
+	unsigned pitches_[vlc::StreamController::MaxPlanes], lines_[vlc::StreamController::MaxPlanes];
+	size_t frameSize_, size_;
+	std::vector<Frame> frames_;
+
+	int64_t getFrameTime(const Frame& frame) const;
+};
+
+#endif
@@ -0,0 +1,480 @@
+//
+//	media_cache.cpp is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#include "media_cache.h"
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <memory>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <wininet.h>
+#endif
+
+using namespace std;
+using namespace vlc;
+
+namespace {
+	struct Entry {
+		string url_;
+		// bytes on disk and total length, if known
+		uint64_t size_ = 0, length_ = 0;
+		bool isComplete_ = false;
+		bool isDownloading_ = false;
+		// URL isn't media itself (e.g. page VLC resolves) - not indexed
+		bool isRejected_ = false;
+		uint64_t lastUse_ = 0;
+	};
+
+	// reads next portion of body; returns false on error, zero bytes on end
+	typedef function<bool(char* buffer, size_t size, size_t& nRead)> Reader;
+
+	// keyed by URL hash, which is entry's file name too
+	typedef map<string, Entry> EntryMap;
+
+	static EntryMap Entries;
+	static deque<string> Downloads;
+	static unsigned nDownloaders = 0;
+	static bool isLoaded = false;
+	// entries with greater value were used more recently
+	static uint64_t lastUse = 0;
+	static string Directory;
+	static mutex CacheAccess;
+
+	string makeKey(const string& url)
+	{
+		// FNV-1a
+		uint64_t hash = 14695981039346656037ull;
+
+		for (unsigned char c : url)
+		{
+			hash ^= c;
+			hash *= 1099511628211ull;
+		}
+
+		char key[17];
+		sprintf(key, "%016llx", (unsigned long long)hash);
+
+		return key;
+	}
+
+	string getPath(const string& key)
+	{
+		return Directory + key + ".media";
+	}
+
+	uint64_t getFileSize(const string& path)
+	{
+		FILE* f = fopen(path.c_str(), "rb");
+
+		if (!f)
+			return UINT64_MAX;
+
+#ifdef _WIN32
+		_fseeki64(f, 0, SEEK_END);
+		uint64_t size = _ftelli64(f);
+#else
+		fseeko(f, 0, SEEK_END);
+		uint64_t size = ftello(f);
+#endif
+		fclose(f);
+
+		return size;
+	}
+
+	// functions below must be called with CacheAccess locked
+	void saveIndex()
+	{
+		ofstream index(Directory + "index.txt", ios::trunc);
+
+		for (auto& it : Entries)
+			index << it.first << "\t" << it.second.size_ << "\t" << it.second.length_ << "\t"
+				<< it.second.isComplete_ << "\t" << it.second.lastUse_ << "\t" << it.second.url_ << "\n";
+	}
+
+	void loadIndex()
+	{
+		if (isLoaded)
+			return;
+
+		isLoaded = true;
+
+#ifdef _WIN32
+		char tempPath[MAX_PATH + 1];
+		DWORD len = GetTempPathA(MAX_PATH + 1, tempPath);
+		Directory = string(tempPath, len) + "YouTubeTOP\\";
+		CreateDirectoryA(Directory.c_str(), NULL);
+#endif
+
+		ifstream index(Directory + "index.txt");
+		string line;
+
+		while (getline(index, line))
+		{
+			istringstream fields(line);
+			string key;
+			Entry entry;
+
+			if (!getline(fields, key, '\t') ||
+				!(fields >> entry.size_ >> entry.length_ >> entry.isComplete_ >> entry.lastUse_) ||
+				!fields.ignore(1) || !getline(fields, entry.url_))
+				continue;
+
+			// whatever is on disk wins - download may have been interrupted
+			uint64_t size = getFileSize(getPath(key));
+
+			if (size == UINT64_MAX)
+				continue;
+
+			entry.isComplete_ = entry.isComplete_ && (size == entry.size_);
+			entry.size_ = size;
+			if (entry.lastUse_ > lastUse)
+				lastUse = entry.lastUse_;
+			Entries[key] = entry;
+		}
+	}
+
+	/**
+	 * Evicts least recently used entries until there's room for given
+	 * number of bytes. Entries being downloaded or played stay.
+	 */
+	bool makeRoom(uint64_t nBytes)
+	{
+		uint64_t total = 0;
+
+		for (auto& it : Entries)
+			total += it.second.size_;
+
+		// files that VLC holds open can't be removed
+		map<string, bool> busy;
+
+		while (total + nBytes > MediaCache::Budget)
+		{
+			EntryMap::iterator lru = Entries.end();
+
+			for (auto it = Entries.begin(); it != Entries.end(); ++it)
+				if (!it->second.isDownloading_ && !busy[it->first] &&
+					(lru == Entries.end() || it->second.lastUse_ < lru->second.lastUse_))
+					lru = it;
+
+			if (lru == Entries.end())
+				return false;
+
+			if (remove(getPath(lru->first).c_str()) == 0)
+			{
+				total -= lru->second.size_;
+				Entries.erase(lru);
+			}
+			else
+				busy[lru->first] = true;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Writes body into entry's file starting at offset. Length is total
+	 * length of media or zero if server didn't tell.
+	 */
+	bool receive(const string& key, uint64_t offset, uint64_t length, Reader read)
+	{
+		{
+			lock_guard<mutex> lock(CacheAccess);
+
+			if (length)
+			{
+				Entries[key].length_ = length;
+
+				if (!makeRoom(length - offset))
+					return false;
+			}
+		}
+
+		FILE* f = fopen(getPath(key).c_str(), offset ? "r+b" : "wb");
+
+		if (!f)
+			return false;
+
+#ifdef _WIN32
+		_fseeki64(f, offset, SEEK_SET);
+#else
+		fseeko(f, offset, SEEK_SET);
+#endif
+
+		static const size_t BufferSize = 64 << 10;
+		unique_ptr<char[]> buffer(new char[BufferSize]);
+		uint64_t size = offset, chunkEnd = offset + MediaCache::ChunkSize;
+		size_t nRead = 0;
+		bool result = true;
+
+		while ((result = read(buffer.get(), BufferSize, nRead)) && nRead)
+		{
+			if (fwrite(buffer.get(), 1, nRead, f) != nRead)
+			{
+				result = false;
+				break;
+			}
+
+			size += nRead;
+
+			if (size >= chunkEnd)
+			{
+				fflush(f);
+				chunkEnd = size + MediaCache::ChunkSize;
+
+				lock_guard<mutex> lock(CacheAccess);
+				Entries[key].size_ = size;
+
+				// length wasn't known up front
+				if (!length && !makeRoom(MediaCache::ChunkSize))
+				{
+					result = false;
+					break;
+				}
+
+				saveIndex();
+			}
+		}
+
+		fclose(f);
+
+		lock_guard<mutex> lock(CacheAccess);
+		Entry& entry = Entries[key];
+		entry.size_ = size;
+		entry.isComplete_ = result && (!length || size == length);
+
+		return entry.isComplete_;
+	}
+
+	bool download(const string& key, const string& url, uint64_t offset)
+	{
+#ifdef _WIN32
+		HINTERNET session = InternetOpenA("YouTubeTOP", INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
+
+		if (!session)
+			return false;
+
+		// resume where previous download stopped
+		string headers;
+		if (offset)
+			headers = "Range: bytes=" + to_string(offset) + "-\r\n";
+
+		HINTERNET request = InternetOpenUrlA(session, url.c_str(), 
+			(headers.empty() ? NULL : headers.c_str()), (DWORD)headers.size(),
+			INTERNET_FLAG_NO_CACHE_WRITE | INTERNET_FLAG_RELOAD, 0);
+		bool result = false;
+
+		if (request)
+		{
+			DWORD code = 0, len = sizeof(code);
+			HttpQueryInfoA(request, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &code, &len, NULL);
+
+			char contentLength[32];
+			uint64_t length = 0;
+			len = sizeof(contentLength);
+
+			if (HttpQueryInfoA(request, HTTP_QUERY_CONTENT_LENGTH, contentLength, &len, NULL))
+				length = _strtoui64(contentLength, NULL, 10);
+
+			// pages and playlists are resolved by VLC on every play - caching
+			// them would only download the page alongside playback
+			char contentType[128];
+			len = sizeof(contentType);
+
+			if (!HttpQueryInfoA(request, HTTP_QUERY_CONTENT_TYPE, contentType, &len, NULL) ||
+				(_strnicmp(contentType, "video/", 6) != 0 && _strnicmp(contentType, "audio/", 6) != 0))
+			{
+				lock_guard<mutex> lock(CacheAccess);
+				Entries[key].isRejected_ = true;
+				code = 0;
+			}
+
+			// server may ignore range - start over then
+			if (code == 200)
+				offset = 0;
+
+			if (code == 200 || code == 206)
+				result = receive(key, offset, (length ? offset + length : 0), 
+					[request](char* buffer, size_t size, size_t& nRead){
+						DWORD n = 0;
+						bool res = (InternetReadFile(request, buffer, (DWORD)size, &n) != FALSE);
+						nRead = n;
+						return res;
+					});
+
+			InternetCloseHandle(request);
+		}
+
+		InternetCloseHandle(session);
+
+		return result;
+#else
+		return false;
+#endif
+	}
+
+#ifdef _WIN32
+	DWORD WINAPI downloadWorker(LPVOID module)
+#else
+	void downloadWorker(void* module)
+#endif
+	{
+		while (true)
+		{
+			string key, url;
+			uint64_t offset = 0;
+
+			{
+				lock_guard<mutex> lock(CacheAccess);
+
+				if (Downloads.empty())
+				{
+					nDownloaders--;
+					break;
+				}
+
+				key = Downloads.front();
+				Downloads.pop_front();
+				url = Entries[key].url_;
+				offset = Entries[key].size_;
+			}
+
+			bool result = download(key, url, offset);
+
+			lock_guard<mutex> lock(CacheAccess);
+			EntryMap::iterator it = Entries.find(key);
+
+			if (it != Entries.end())
+			{
+				it->second.isDownloading_ = false;
+
+				// e.g. link has expired - nothing to resume
+				if (!result && it->second.size_ == 0 && !it->second.isRejected_)
+				{
+					remove(getPath(key).c_str());
+					Entries.erase(it);
+				}
+			}
+
+			saveIndex();
+		}
+
+#ifdef _WIN32
+		// must not return into the DLL code after releasing it. thread is
+		// ours (not CRT's), so exiting it here skips no cleanup
+		if (module)
+			FreeLibraryAndExitThread((HMODULE)module, 0);
+
+		return 0;
+#endif
+	}
+}
+
+bool MediaCache::lookup(const std::string& url, std::string& path)
+{
+	lock_guard<mutex> lock(CacheAccess);
+	loadIndex();
+
+	string key = makeKey(url);
+	EntryMap::iterator it = Entries.find(key);
+
+	if (it == Entries.end() || it->second.url_ != url || !it->second.isComplete_)
+		return false;
+
+	path = getPath(key);
+
+	// removed behind our back
+	if (getFileSize(path) != it->second.size_)
+	{
+		remove(path.c_str());
+		Entries.erase(it);
+		saveIndex();
+
+		return false;
+	}
+
+	it->second.lastUse_ = ++lastUse;
+	saveIndex();
+
+	return true;
+}
+
+void MediaCache::fetch(const std::string& url)
+{
+	if (url.compare(0, 7, "http://") != 0 && url.compare(0, 8, "https://") != 0)
+		return;
+
+	lock_guard<mutex> lock(CacheAccess);
+	loadIndex();
+
+	string key = makeKey(url);
+	Entry& entry = Entries[key];
+
+	// hash collision - newer URL takes the slot over
+	if (entry.url_ != url)
+	{
+		if (entry.isDownloading_)
+			return;
+
+		entry = Entry();
+		entry.url_ = url;
+	}
+
+	entry.lastUse_ = ++lastUse;
+
+	if (entry.isComplete_ || entry.isDownloading_ || entry.isRejected_)
+		return;
+
+	entry.isDownloading_ = true;
+	Downloads.push_back(key);
+
+	if (nDownloaders < MaxDownloads)
+	{
+		nDownloaders++;
+
+		void* module = nullptr;
+#ifdef _WIN32
+		// worker may outlive the TOP - don't let DLL unload under it
+		GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, 
+			(LPCTSTR)&downloadWorker, (HMODULE*)&module);
+
+		HANDLE worker = CreateThread(NULL, 0, &downloadWorker, module, 0, NULL);
+
+		if (worker)
+			CloseHandle(worker);
+		else
+		{
+			// queued download is picked up by the next worker
+			nDownloaders--;
+			if (module)
+				FreeLibrary((HMODULE)module);
+		}
+#else
+		thread(&downloadWorker, module).detach();
+#endif
+	}
+}
@@ -0,0 +1,60 @@
+//
+//	media_cache.h is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#ifndef __media_cache_h__
+#define __media_cache_h__
+
+#include <string>
+#include <cstdint>
+
+namespace vlc {
+	/*
+	Thread-safe process-wide on-disk cache of streamed media, so that loops
+	and handovers which play the same URL again are served from local disk
+	instead of the network. Media is downloaded in background, chunk by 
+	chunk, alongside the first playback; interrupted downloads resume from
+	the last complete chunk. Index survives restarts, total size is kept
+	under budget by evicting least recently played entries. Only audio and
+	video responses are cached - URLs that VLC resolves (e.g. watch pages)
+	are streamed every time.
+	*/
+	class MediaCache {
+	public:
+		static const uint64_t Budget = 4ull << 30;
+		// progress is written to index after every chunk
+		static const uint64_t ChunkSize = 4ull << 20;
+		static const unsigned MaxDownloads = 2;
+
+		/**
+		 * Returns true and path of local copy if URL is cached completely.
+		 * Marks entry as most recently used.
+		 */
+		static bool lookup(const std::string& url, std::string& path);
+
+		/**
+		 * Queues background download of URL unless it's cached, being
+		 * downloaded, isn't a network URL or turned out not to be media.
+		 * Never blocks.
+		 */
+		static void fetch(const std::string& url);
+	};
+}
+
+#endif
@@ -0,0 +1,111 @@
+//
+//	media_info_cache.cpp is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#include "media_info_cache.h"
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <string.h>
+
+using namespace std;
+using namespace vlc;
+
+typedef list<pair<string, MediaInfo>> EntryList;
+typedef map<string, EntryList::iterator> EntryMap;
+
+// most recently used entries are in front
+static EntryList Entries;
+static EntryMap EntryIndex;
+static mutex CacheAccess;
+
+bool MediaInfoCache::lookup(const std::string& url, MediaInfo& info)
+{
+	lock_guard<mutex> lock(CacheAccess);
+	EntryMap::iterator it = EntryIndex.find(url);
+
+	if (it == EntryIndex.end())
+		return false;
+
+	Entries.splice(Entries.begin(), Entries, it->second);
+	info = it->second->second;
+
+	return true;
+}
+
+void MediaInfoCache::store(const std::string& url, const MediaInfo& info)
+{
+	lock_guard<mutex> lock(CacheAccess);
+	EntryMap::iterator it = EntryIndex.find(url);
+
+	if (it != EntryIndex.end())
+	{
+		it->second->second = info;
+		Entries.splice(Entries.begin(), Entries, it->second);
+		return;
+	}
+
+	Entries.push_front(make_pair(url, info));
+	EntryIndex[url] = Entries.begin();
+
+	if (Entries.size() > Capacity)
+	{
+		EntryIndex.erase(Entries.back().first);
+		Entries.pop_back();
+	}
+}
+
+bool MediaInfoCache::read(libvlc_media_t* media, MediaInfo& info)
+{
+	libvlc_media_track_t **tracks = NULL;
+	unsigned nTracks = libvlc_media_tracks_get(media, &tracks);
+
+	memset(&info, 0, sizeof(info));
+	info.duration_ = libvlc_media_get_duration(media);
+
+	for (unsigned i = 0; i < nTracks; i++)
+	{
+		if (tracks[i]->i_type == libvlc_track_video)
+		{
+			// we assume 1 video track
+			if (info.nVideoTracks_++ == 0)
+			{
+				info.width_ = tracks[i]->video->i_width;
+				info.height_ = tracks[i]->video->i_height;
+
+				if (tracks[i]->video->i_frame_rate_den)
+					info.fps_ = double(tracks[i]->video->i_frame_rate_num) / double(tracks[i]->video->i_frame_rate_den);
+			}
+		}
+		else if (tracks[i]->i_type == libvlc_track_audio)
+		{
+			if (info.nAudioTracks_++ == 0)
+			{
+				info.audioRate_ = tracks[i]->audio->i_rate;
+				info.audioChannels_ = tracks[i]->audio->i_channels;
+			}
+		}
+	}
+
+	if (nTracks && tracks != NULL)
+		libvlc_media_tracks_release(tracks, nTracks);
+
+	return (info.fps_ > 0);
+}
@@ -0,0 +1,57 @@
+//
+//	media_info_cache.h is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#ifndef __media_info_cache_h__
+#define __media_info_cache_h__
+
+#include <string>
+#include <cstdint>
+
+#include <vlc/vlc.h>
+
+namespace vlc {
+	struct MediaInfo {
+		int64_t duration_;
+		double fps_;
+		unsigned width_, height_;
+		unsigned nVideoTracks_, nAudioTracks_;
+		unsigned audioRate_, audioChannels_;
+	};
+
+	/*
+	Thread-safe process-wide LRU cache of media properties keyed by URL, so
+	that handover and loop restarts of a URL don't need to parse it again.
+	*/
+	class MediaInfoCache {
+	public:
+		static const unsigned Capacity = 64;
+
+		static bool lookup(const std::string& url, MediaInfo& info);
+		static void store(const std::string& url, const MediaInfo& info);
+
+		/**
+		 * Reads media properties from tracks VLC knows about. Doesn't parse
+		 * media. Returns false if there's no video track with frame rate yet.
+		 */
+		static bool read(libvlc_media_t* media, MediaInfo& info);
+	};
+}
+
+#endif
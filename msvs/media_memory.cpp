@@ -0,0 +1,151 @@
+//
+//	media_memory.cpp is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#include "media_memory.h"
+
+#include <map>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+using namespace vlc;
+
+typedef map<string, weak_ptr<const MediaMemory::Buffer>> BufferMap;
+
+static BufferMap Buffers;
+static mutex BuffersAccess;
+
+namespace {
+#if LIBVLC_VERSION_INT >= LIBVLC_VERSION(3, 0, 0, 0)
+	struct Reader {
+		const MediaMemory::Buffer* buffer_;
+		uint64_t position_;
+	};
+
+	int openCB(void *opaque, void **data, uint64_t *size)
+	{
+		auto buffer = reinterpret_cast<const MediaMemory::Buffer*>(opaque);
+
+		*data = new Reader({ buffer, 0 });
+		*size = buffer->size();
+
+		return 0;
+	}
+
+	ssize_t readCB(void *data, unsigned char *buf, size_t len)
+	{
+		auto reader = reinterpret_cast<Reader*>(data);
+		uint64_t left = reader->buffer_->size() - reader->position_;
+
+		if (len > left)
+			len = (size_t)left;
+
+		memcpy(buf, reader->buffer_->data() + reader->position_, len);
+		reader->position_ += len;
+
+		return (ssize_t)len;
+	}
+
+	int seekCB(void *data, uint64_t offset)
+	{
+		auto reader = reinterpret_cast<Reader*>(data);
+
+		if (offset > reader->buffer_->size())
+			return -1;
+
+		reader->position_ = offset;
+
+		return 0;
+	}
+
+	void closeCB(void *data)
+	{
+		delete reinterpret_cast<Reader*>(data);
+	}
+#endif
+}
+
+std::shared_ptr<const MediaMemory::Buffer> 
+MediaMemory::load(const std::string& url, const std::string& path, uint64_t maxSize)
+{
+	lock_guard<mutex> lock(BuffersAccess);
+	shared_ptr<const Buffer> buffer = Buffers[url].lock();
+
+	if (buffer)
+		return buffer;
+
+	FILE* f = fopen(path.c_str(), "rb");
+
+	if (!f)
+		return nullptr;
+
+#ifdef _WIN32
+	_fseeki64(f, 0, SEEK_END);
+	uint64_t size = _ftelli64(f);
+	_fseeki64(f, 0, SEEK_SET);
+#else
+	fseeko(f, 0, SEEK_END);
+	uint64_t size = ftello(f);
+	fseeko(f, 0, SEEK_SET);
+#endif
+
+	shared_ptr<Buffer> data;
+
+	if (size && size <= maxSize)
+	{
+		data = make_shared<Buffer>((size_t)size);
+
+		if (fread(data->data(), 1, data->size(), f) != data->size())
+			data.reset();
+	}
+
+	fclose(f);
+
+	// drop entries of clips nobody plays anymore
+	for (BufferMap::iterator it = Buffers.begin(); it != Buffers.end();)
+		if (it->second.expired())
+			it = Buffers.erase(it);
+		else
+			++it;
+
+	if (data)
+		Buffers[url] = data;
+
+	return data;
+}
+
+bool MediaMemory::isSupported()
+{
+#if LIBVLC_VERSION_INT >= LIBVLC_VERSION(3, 0, 0, 0)
+	return true;
+#else
+	return false;
+#endif
+}
+
+libvlc_media_t* MediaMemory::newMedia(libvlc_instance_t* instance, const Buffer* buffer)
+{
+#if LIBVLC_VERSION_INT >= LIBVLC_VERSION(3, 0, 0, 0)
+	return libvlc_media_new_callbacks(instance, &openCB, &readCB, &seekCB, &closeCB, (void*)buffer);
+#else
+	return nullptr;
+#endif
+}
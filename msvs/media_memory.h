@@ -0,0 +1,63 @@
+//
+//	media_memory.h is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#ifndef __media_memory_h__
+#define __media_memory_h__
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include <vlc/vlc.h>
+
+namespace vlc {
+	/*
+	Process-wide store of short clips held in RAM, so that loops, seeks and
+	handovers of such clips don't touch network or disk at all. Clips are 
+	loaded from MediaCache's local copies and shared by every controller
+	playing the same URL; memory is freed when the last one lets go.
+	*/
+	class MediaMemory {
+	public:
+		typedef std::vector<uint8_t> Buffer;
+
+		static const uint64_t DefaultMaxSize = 64ull << 20;
+
+		/**
+		 * Returns in-memory copy of URL cached on disk at path. Returns
+		 * nullptr if file is larger than maxSize or can't be read.
+		 */
+		static std::shared_ptr<const Buffer> load(const std::string& url, 
+			const std::string& path, uint64_t maxSize);
+
+		/**
+		 * Creates media which VLC reads straight from buffer. Buffer must
+		 * outlive the media and every player it was set to. Requires 
+		 * libvlc 3.0 - returns nullptr for older versions.
+		 */
+		static libvlc_media_t* newMedia(libvlc_instance_t* instance, const Buffer* buffer);
+
+		// false if libvlc is older than 3.0 - clips are never played from RAM
+		static bool isSupported();
+	};
+}
+
+#endif
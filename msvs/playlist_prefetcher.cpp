@@ -0,0 +1,227 @@
+//
+//	playlist_prefetcher.cpp is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#include "playlist_prefetcher.h"
+
+#include <sstream>
+#include <algorithm>
+
+using namespace vlc;
+
+PlaylistPrefetcher::PlaylistPrefetcher(Acquire acquire, Release release, Play play):
+acquire_(acquire), release_(release), play_(play), lastFrameSize_(0)
+{
+}
+
+std::vector<std::string> 
+PlaylistPrefetcher::parse(const std::string& text)
+{
+	std::vector<std::string> urls;
+	std::istringstream lines(text);
+	std::string line;
+
+	while (std::getline(lines, line))
+	{
+		line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+
+		size_t begin = line.find_first_not_of(" \t");
+		size_t end = line.find_last_not_of(" \t");
+
+		if (begin != std::string::npos)
+			urls.push_back(line.substr(begin, end - begin + 1));
+	}
+
+	return urls;
+}
+
+void PlaylistPrefetcher::update(const std::vector<std::string>& urls, unsigned maxDepth,
+	size_t memoryBudget, unsigned maxBuffering)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	for (auto& item : items_)
+	{
+		if (!item.controller_)
+			continue;
+
+		item.controller_->getStatus(item.status_);
+
+		// state may still be the one controller had before play request
+		if (item.status_.nPendingCommands_ != 0)
+			continue;
+
+		if (item.status_.videoInfo_.frameSize_)
+			lastFrameSize_ = item.status_.videoInfo_.frameSize_;
+
+		if (item.status_.state_ == libvlc_Error)
+		{
+			int64_t delayMs = RetryDelayMs << (item.nFailures_ < 6 ? item.nFailures_ : 6);
+
+			if (delayMs > MaxRetryDelayMs)
+				delayMs = MaxRetryDelayMs;
+
+			release_(item.controller_);
+			item.controller_ = nullptr;
+			item.isPaused_ = false;
+			item.nFailures_++;
+			item.retryTime_ = now + std::chrono::milliseconds(delayMs);
+		}
+		// first frame is decoded - switch can show it right away. keeps
+		// buffering while paused
+		else if (!item.isPaused_ && item.status_.isVideoInfoReady_ &&
+			item.controller_->getLatestFrame())
+		{
+			item.controller_->pause(true);
+			item.isPaused_ = true;
+		}
+	}
+
+	// what fits into budgets, in order of priority
+	size_t cost = 0;
+	unsigned depth = (maxDepth < MaxDepth ? maxDepth : MaxDepth);
+
+	wanted_.clear();
+
+	for (auto& url : urls)
+	{
+		if (wanted_.size() >= depth)
+			break;
+		if (isWanted(url))
+			continue;
+		if (cost + getCost(url) > memoryBudget)
+			break;
+
+		cost += getCost(url);
+		wanted_.push_back(&url);
+	}
+
+	for (auto it = items_.begin(); it != items_.end();)
+	{
+		if (!isWanted(it->url_))
+		{
+			if (it->controller_)
+				release_(it->controller_);
+			it = items_.erase(it);
+		}
+		else
+			++it;
+	}
+
+	unsigned nBuffering = getNBuffering();
+
+	for (auto urlPtr : wanted_)
+	{
+		const std::string& url = *urlPtr;
+
+		if (nBuffering >= maxBuffering)
+			break;
+
+		auto it = std::find_if(items_.begin(), items_.end(), 
+			[&url](const Item& item){ return item.url_ == url; });
+
+		if (it != items_.end())
+		{
+			if (!it->controller_ && now >= it->retryTime_)
+			{
+				start(*it);
+				nBuffering++;
+			}
+
+			continue;
+		}
+
+		Item item;
+		item.url_ = url;
+		item.nFailures_ = 0;
+		start(item);
+
+		items_.push_back(item);
+		nBuffering++;
+	}
+}
+
+void PlaylistPrefetcher::start(Item& item)
+{
+	item.controller_ = acquire_();
+	item.isPaused_ = false;
+	play_(item.controller_, item.url_);
+	item.controller_->getStatus(item.status_);
+}
+
+StreamController* PlaylistPrefetcher::take(const std::string& url)
+{
+	auto it = std::find_if(items_.begin(), items_.end(),
+		[&url](const Item& item){ return item.url_ == url; });
+
+	if (it == items_.end() || !it->controller_ || it->status_.state_ == libvlc_Error)
+		return nullptr;
+
+	StreamController* controller = it->controller_;
+	items_.erase(it);
+
+	return controller;
+}
+
+void PlaylistPrefetcher::clear()
+{
+	for (auto& item : items_)
+		if (item.controller_)
+			release_(item.controller_);
+
+	items_.clear();
+}
+
+unsigned PlaylistPrefetcher::getNReady() const
+{
+	return (unsigned)std::count_if(items_.begin(), items_.end(), &PlaylistPrefetcher::isReady);
+}
+
+unsigned PlaylistPrefetcher::getNBuffering() const
+{
+	return (unsigned)std::count_if(items_.begin(), items_.end(), [](const Item& item){
+		return item.controller_ && !isReady(item) && item.status_.state_ != libvlc_Error;
+	});
+}
+
+bool PlaylistPrefetcher::isReady(const Item& item)
+{
+	// paused on first decoded frame only
+	return (item.controller_ != nullptr && item.isPaused_);
+}
+
+bool PlaylistPrefetcher::isWanted(const std::string& url) const
+{
+	for (auto wanted : wanted_)
+		if (*wanted == url)
+			return true;
+
+	return false;
+}
+
+size_t PlaylistPrefetcher::getCost(const std::string& url) const
+{
+	size_t frameSize = lastFrameSize_;
+
+	for (auto& item : items_)
+		if (item.url_ == url && item.status_.videoInfo_.frameSize_)
+			frameSize = item.status_.videoInfo_.frameSize_;
+
+	return frameSize * StreamController::DefaultFrameSlots + PlayerOverhead;
+}
@@ -0,0 +1,110 @@
+//
+//	playlist_prefetcher.h is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#ifndef __playlist_prefetcher_h__
+#define __playlist_prefetcher_h__
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+
+#include "stream_controller.h"
+
+/*
+Keeps next items of a playlist prebuffered and paused on spare controllers,
+so that switching to any of them needs neither a play request nor waiting
+for buffering. How many items are prefetched is bounded by depth and by 
+memory budget; how many are buffering at once - by bandwidth budget.
+Items that fail give their controllers back and are retried with growing
+delay. Controllers come from and go back to the owner through callbacks.
+Must be used from one thread.
+*/
+class PlaylistPrefetcher {
+public:
+	typedef std::function<vlc::StreamController*()> Acquire;
+	typedef std::function<void(vlc::StreamController*)> Release;
+	typedef std::function<void(vlc::StreamController*, const std::string& url)> Play;
+
+	static const unsigned MaxDepth = 8;
+	// delay before failed item is retried, doubled with every failure
+	static const int64_t RetryDelayMs = 1000;
+	static const int64_t MaxRetryDelayMs = 60000;
+	// estimate of decoder, demuxer and network cache of a player, on top of its frames
+	static const size_t PlayerOverhead = (size_t)32 << 20;
+
+	PlaylistPrefetcher(Acquire acquire, Release release, Play play);
+
+	/**
+	 * Parses playlist text - one URL per line. Blank lines are skipped.
+	 */
+	static std::vector<std::string> parse(const std::string& text);
+
+	/**
+	 * Called every cook with URLs that may be played next, most likely 
+	 * first. Pauses prefetches on their first decoded frame, starts new 
+	 * ones while budgets allow and releases the ones that aren't wanted 
+	 * or have failed.
+	 */
+	void update(const std::vector<std::string>& urls, unsigned maxDepth,
+		size_t memoryBudget, unsigned maxBuffering);
+
+	/**
+	 * Returns paused controller prefetching URL, or nullptr if there's none.
+	 * Controller is not managed by prefetcher anymore. It resumes from
+	 * wherever it was paused, so owner seeks it to start if needed.
+	 */
+	vlc::StreamController* take(const std::string& url);
+
+	void clear();
+
+	// items paused on their first decoded frame
+	unsigned getNReady() const;
+	// items which are neither ready nor waiting for retry
+	unsigned getNBuffering() const;
+	unsigned getNItems() const { return (unsigned)items_.size(); }
+
+private:
+	struct Item {
+		std::string url_;
+		// nullptr while failed item waits for retry
+		vlc::StreamController* controller_;
+		vlc::StreamController::Status status_;
+		bool isPaused_;
+		unsigned nFailures_;
+		std::chrono::steady_clock::time_point retryTime_;
+	};
+
+	Acquire acquire_;
+	Release release_;
+	Play play_;
+	std::vector<Item> items_;
+	// used for items which haven't reported their frame size yet
+	size_t lastFrameSize_;
+	// URLs which fit into budgets, kept between updates not to allocate
+	std::vector<const std::string*> wanted_;
+
+	static bool isReady(const Item& item);
+	void start(Item& item);
+	bool isWanted(const std::string& url) const;
+	size_t getCost(const std::string& url) const;
+};
+
+#endif
@@ -0,0 +1,149 @@
+//
+//	resampler.cpp is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+
+#include "resampler.h"
+#include "audio_kernels.h"
+
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+using namespace audio;
+
+// frames of history kept before current position
+static const unsigned HalfTaps = Resampler::NTaps / 2;
+
+Resampler::Resampler() : nChannels_(0), inRate_(1), outRate_(1), position_(0)
+{
+	reset(0, 1, 1);
+}
+
+void Resampler::reset(unsigned nChannels, double inRate, double outRate)
+{
+	bool rateChanged = (filter_.empty() || inRate != inRate_ || outRate != outRate_);
+
+	nChannels_ = nChannels;
+	inRate_ = inRate;
+	outRate_ = outRate;
+	position_ = HalfTaps - 1;
+
+	input_.resize(nChannels_);
+	inputPtrs_.resize(nChannels_);
+
+	for (auto& in : input_)
+	{
+		in.reserve(8192);
+		in.assign(HalfTaps - 1, 0.f);
+	}
+
+	if (rateChanged)
+		makeFilter();
+}
+
+size_t Resampler::getInputNeeded(size_t nFrames, double ratio) const
+{
+	if (nChannels_ == 0 || nFrames == 0)
+		return 0;
+
+	size_t last = (size_t)floor(position_ + (nFrames - 1)*ratio) + HalfTaps + 1;
+	size_t have = input_[0].size();
+
+	return (last > have ? last - have : 0);
+}
+
+float* const* Resampler::prepareInput(size_t nFrames)
+{
+	for (unsigned i = 0; i < nChannels_; ++i)
+	{
+		size_t size = input_[i].size();
+		input_[i].resize(size + nFrames);
+		inputPtrs_[i] = input_[i].data() + size;
+	}
+
+	return inputPtrs_.data();
+}
+
+void Resampler::process(float* const* out, size_t nFrames, double ratio)
+{
+	if (nChannels_ == 0)
+		return;
+
+	double position = position_;
+
+	for (size_t k = 0; k < nFrames; ++k, position += ratio)
+	{
+		size_t n = (size_t)position;
+		double phase = (position - n) * NPhases;
+		unsigned row = (unsigned)phase;
+		float fraction = (float)(phase - row);
+		const float* h0 = filter_.data() + row*NTaps;
+		const float* h1 = h0 + NTaps;
+
+		for (unsigned i = 0; i < nChannels_; ++i)
+		{
+			const float* x = input_[i].data() + n - (HalfTaps - 1);
+			float y0 = dot(x, h0, NTaps), y1 = dot(x, h1, NTaps);
+
+			out[i][k] = y0 + fraction*(y1 - y0);
+		}
+	}
+
+	// keep history needed for the next output frame
+	size_t drop = (size_t)position - (HalfTaps - 1);
+
+	for (auto& in : input_)
+		in.erase(in.begin(), in.begin() + (drop < in.size() ? drop : in.size()));
+
+	position_ = position - drop;
+}
+
+void Resampler::makeFilter()
+{
+	// when downsampling, cut off below output's Nyquist
+	double cutoff = 0.95 * (outRate_ < inRate_ ? outRate_ / inRate_ : 1.);
+
+	filter_.resize((NPhases + 1) * NTaps);
+
+	for (unsigned p = 0; p <= NPhases; ++p)
+	{
+		float* row = filter_.data() + p*NTaps;
+		double sum = 0;
+
+		for (unsigned i = 0; i < NTaps; ++i)
+		{
+			// distance from tap to output position, in input frames
+			double t = (double)i - (HalfTaps - 1) - (double)p / NPhases;
+			double x = M_PI * cutoff * t;
+			double sinc = (x == 0 ? 1. : sin(x) / x);
+			double w = t / HalfTaps;
+			double window = 0.42 + 0.5*cos(M_PI*w) + 0.08*cos(2 * M_PI*w);
+
+			row[i] = (float)(cutoff * sinc * window);
+			sum += row[i];
+		}
+
+		// unity gain at DC for every phase
+		for (unsigned i = 0; i < NTaps; ++i)
+			row[i] = (float)(row[i] / sum);
+	}
+}
@@ -0,0 +1,71 @@
+//
+//	resampler.h is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+
+#ifndef __resampler_h__
+#define __resampler_h__
+
+#include <vector>
+#include <cstddef>
+
+namespace audio {
+	/*
+	Streaming polyphase windowed-sinc resampler for planar float audio.
+	Ratio (input frames per output frame) may change on every call, which
+	allows to slowly steer it for clock drift compensation. Fractional
+	positions between filter phases are interpolated linearly.
+	*/
+	class Resampler {
+	public:
+		static const unsigned NTaps = 16;
+		static const unsigned NPhases = 64;
+
+		Resampler();
+
+		// drops buffered input, rebuilds filter if rates changed
+		void reset(unsigned nChannels, double inRate, double outRate);
+
+		// number of input frames to add before producing nFrames output frames
+		size_t getInputNeeded(size_t nFrames, double ratio) const;
+		// grows input by nFrames, returns per-channel pointers to fill
+		float* const* prepareInput(size_t nFrames);
+		// writes nFrames frames into out[0..nChannels)
+		void process(float* const* out, size_t nFrames, double ratio);
+
+		unsigned getChannels() const { return nChannels_; }
+		double getInputRate() const { return inRate_; }
+		double getOutputRate() const { return outRate_; }
+		double getNominalRatio() const { return inRate_ / outRate_; }
+
+	private:
+		unsigned nChannels_;
+		double inRate_, outRate_;
+		// position of the next output frame, in input frames
+		double position_;
+		std::vector<std::vector<float>> input_;
+		std::vector<float*> inputPtrs_;
+		// NPhases+1 rows of NTaps coefficients
+		std::vector<float> filter_;
+
+		void makeFilter();
+	};
+}
+
+#endif
@@ -0,0 +1,97 @@
+//
+//	seqlock.h is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#ifndef __seqlock_h__
+#define __seqlock_h__
+
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <string.h>
+#include <type_traits>
+
+/*
+Publishes snapshots of a plain struct without locks. Readers never block
+writers: they copy the value and retry if a write happened meanwhile.
+Writers must be serialized by the caller.
+*/
+template<typename T>
+class SeqLock {
+	static_assert(std::is_trivially_copyable<T>::value, "SeqLock needs trivially copyable type");
+
+public:
+	SeqLock() : sequence_(0)
+	{
+		for (auto& w : words_)
+			w.store(0, std::memory_order_relaxed);
+	}
+
+	void store(const T& value)
+	{
+		uint64_t words[NWords] = { 0 };
+		memcpy(words, &value, sizeof(T));
+
+		unsigned sequence = sequence_.load(std::memory_order_relaxed);
+
+		// odd sequence tells readers that write is in progress
+		sequence_.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		for (size_t i = 0; i < NWords; ++i)
+			words_[i].store(words[i], std::memory_order_relaxed);
+
+		sequence_.store(sequence + 2, std::memory_order_release);
+	}
+
+	T load() const
+	{
+		uint64_t words[NWords];
+		unsigned before, after;
+
+		do {
+			before = sequence_.load(std::memory_order_acquire);
+
+			if (before & 1)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			for (size_t i = 0; i < NWords; ++i)
+				words[i] = words_[i].load(std::memory_order_relaxed);
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			after = sequence_.load(std::memory_order_relaxed);
+		} while ((before & 1) || before != after);
+
+		T value;
+		memcpy(&value, words, sizeof(T));
+
+		return value;
+	}
+
+private:
+	static const size_t NWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	std::atomic<unsigned> sequence_;
+	std::atomic<uint64_t> words_[NWords];
+};
+
+#endif
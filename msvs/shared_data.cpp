@@ -22,6 +22,8 @@
 #include <map>
 #include <vector>
 #include <set>
+#include <memory>
+#include <atomic>
 
 #include "youtube_chop.h"
 #include "youtube_top.h"
@@ -33,14 +35,22 @@ typedef set<YouTubeTOP*> TopArrayType;
 typedef map<string, YouTubeTOP*> TopMapType;
 
 static TopArrayType TopArray;
-static TopMapType TopMap;
+// copy-on-write: replaced as a whole under TopAccess, loaded atomically
+static shared_ptr<const TopMapType> TopMap = make_shared<TopMapType>();
+static atomic<uint64_t> Generation(0);
+// serializes writers
 static mutex TopAccess;
 
 void SharedData::addTop(YouTubeTOP * top)
 {
 	ScopedLock lock(TopAccess);
+	shared_ptr<TopMapType> updated = make_shared<TopMapType>(*atomic_load(&TopMap));
+
 	TopArray.insert(top);
-	TopMap[top->getNodeFullPath()] = top;
+	(*updated)[top->getNodeFullPath()] = top;
+
+	atomic_store(&TopMap, shared_ptr<const TopMapType>(updated));
+	Generation++;
 }
 
 void SharedData::removeTop(YouTubeTOP * top)
@@ -48,19 +58,86 @@ void SharedData::removeTop(YouTubeTOP * top)
 	ScopedLock lock(TopAccess);
 	if (TopArray.find(top) != TopArray.end())
 	{
+		shared_ptr<TopMapType> updated = make_shared<TopMapType>(*atomic_load(&TopMap));
+
 		TopArray.erase(top);
-		if (TopMap.find(top->getNodeFullPath()) != TopMap.end())
-			TopMap.erase(top->getNodeFullPath());
+		// node may have been renamed since it was added
+		for (TopMapType::iterator it = updated->begin(); it != updated->end();)
+		{
+			if (it->second == top)
+				it = updated->erase(it);
+			else
+				++it;
+		}
+
+		atomic_store(&TopMap, shared_ptr<const TopMapType>(updated));
+		Generation++;
 	}
 }
 
+uint64_t SharedData::getGeneration()
+{
+	return Generation;
+}
+
+typedef map<StreamKey, YouTubeTOP*> StreamMapType;
+
+static StreamMapType StreamMap;
+static mutex StreamAccess;
+
 YouTubeTOP * SharedData::getTop(const std::string & topNodeName)
 {
-#if 1
-//	ScopedLock lock(TopAccess);
+	shared_ptr<const TopMapType> topMap = atomic_load(&TopMap);
+	TopMapType::const_iterator it = topMap->find(topNodeName);
+
+	return (it != topMap->end() ? it->second : nullptr);
+}
+
+bool StreamKey::operator<(const StreamKey& other) const
+{
+	if (url_ != other.url_)
+		return url_ < other.url_;
+	if (startTimeMs_ != other.startTimeMs_)
+		return startTimeMs_ < other.startTimeMs_;
+	if (speed_ != other.speed_)
+		return speed_ < other.speed_;
+	if (maxWidth_ != other.maxWidth_)
+		return maxWidth_ < other.maxWidth_;
+	if (maxHeight_ != other.maxHeight_)
+		return maxHeight_ < other.maxHeight_;
+	return chroma_ < other.chroma_;
+}
+
+bool StreamKey::operator==(const StreamKey& other) const
+{
+	return url_ == other.url_ && startTimeMs_ == other.startTimeMs_ &&
+		speed_ == other.speed_ && maxWidth_ == other.maxWidth_ &&
+		maxHeight_ == other.maxHeight_ && chroma_ == other.chroma_;
+}
+
+bool StreamRegistry::publish(const StreamKey& key, YouTubeTOP* top)
+{
+	ScopedLock lock(StreamAccess);
+	return StreamMap.insert(make_pair(key, top)).second;
+}
+
+void StreamRegistry::withdraw(YouTubeTOP* top)
+{
+	ScopedLock lock(StreamAccess);
+
+	for (StreamMapType::iterator it = StreamMap.begin(); it != StreamMap.end();)
+	{
+		if (it->second == top)
+			it = StreamMap.erase(it);
+		else
+			++it;
+	}
+}
+
+YouTubeTOP* StreamRegistry::find(const StreamKey& key)
+{
+	ScopedLock lock(StreamAccess);
+	StreamMapType::iterator it = StreamMap.find(key);
 
-	if (TopMap.find(topNodeName) != TopMap.end())
-		return TopMap[topNodeName];
-#endif
-	return nullptr;
+	return (it != StreamMap.end() ? it->second : nullptr);
 }
@@ -23,15 +23,52 @@
 
 #include <string>
 #include <mutex>
+#include <cstdint>
 
 class YouTubeTOP;
 
-// thread-safe class for sharing data between CHOPs and TOPs
+/*
+Thread-safe class for sharing data between CHOPs and TOPs. TOPs are looked
+up without locking: registry is copy-on-write, so readers work on a
+snapshot while TOPs are added or removed.
+*/
 class SharedData {
 public:
 	static void addTop(YouTubeTOP* top);
 	static void removeTop(YouTubeTOP* top);
 	static YouTubeTOP* getTop(const std::string& topNodeName);
+
+	/**
+	 * Changes whenever a TOP is added or removed, so that whoever has
+	 * looked TOP up can keep the pointer until generation changes.
+	 */
+	static uint64_t getGeneration();
+};
+
+// identifies decoded stream which several TOPs can share
+struct StreamKey {
+	std::string url_;
+	int startTimeMs_;
+	float speed_;
+	// decode bound (zero means native size) and StreamController::Chroma
+	unsigned maxWidth_, maxHeight_;
+	int chroma_;
+
+	bool operator<(const StreamKey& other) const;
+	bool operator==(const StreamKey& other) const;
+};
+
+/*
+Thread-safe registry of TOPs which decode a stream themselves, so that
+other TOPs playing the same stream can render their frames instead of
+running decoders of their own. There's at most one TOP per stream.
+*/
+class StreamRegistry {
+public:
+	// returns false if stream already has a TOP decoding it
+	static bool publish(const StreamKey& key, YouTubeTOP* top);
+	static void withdraw(YouTubeTOP* top);
+	static YouTubeTOP* find(const StreamKey& key);
 };
 
 #endif
@@ -0,0 +1,90 @@
+//
+//	spsc_queue.h is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#ifndef __spsc_queue_h__
+#define __spsc_queue_h__
+
+#include <atomic>
+#include <cstddef>
+
+/*
+Bounded lock-free queue for exactly one producer thread and one consumer
+thread. Neither side ever waits for the other: push() fails when the queue
+is full, pop() fails when it's empty.
+*/
+template<typename T, size_t Capacity>
+class SpscQueue {
+public:
+	SpscQueue() : head_(0), tail_(0) {}
+
+	// producer side
+	bool push(T&& item)
+	{
+		size_t tail = tail_.load(std::memory_order_relaxed);
+		size_t next = (tail + 1) % Size;
+
+		if (next == head_.load(std::memory_order_acquire))
+			return false;
+
+		items_[tail] = std::move(item);
+		tail_.store(next, std::memory_order_release);
+
+		return true;
+	}
+
+	// consumer side
+	bool pop(T& item)
+	{
+		size_t head = head_.load(std::memory_order_relaxed);
+
+		if (head == tail_.load(std::memory_order_acquire))
+			return false;
+
+		item = std::move(items_[head]);
+		// don't hold on to resources of consumed item
+		items_[head] = T();
+		head_.store((head + 1) % Size, std::memory_order_release);
+
+		return true;
+	}
+
+	// approximate when called concurrently with push() or pop()
+	size_t size() const
+	{
+		size_t head = head_.load(std::memory_order_acquire);
+		size_t tail = tail_.load(std::memory_order_acquire);
+
+		return (tail + Size - head) % Size;
+	}
+
+	bool empty() const { return size() == 0; }
+
+private:
+	// one slot is always kept empty to tell full queue from empty one
+	static const size_t Size = Capacity + 1;
+
+	T items_[Size];
+	std::atomic<size_t> head_;
+	// keep indices on separate cache lines
+	char padding_[64];
+	std::atomic<size_t> tail_;
+};
+
+#endif
@@ -19,10 +19,24 @@
 //	Author: Peter Gusev, peter@remap.ucla.edu
 
 #include "stream_controller.h"
+#include "instance_pool.h"
+#include "spsc_queue.h"
+#include "seqlock.h"
+#include "media_info_cache.h"
+#include "media_cache.h"
+#include "media_memory.h"
 #include <iostream>
 #include <ctime>
 #include <chrono>
 #include <sstream>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
 using namespace std;
 
@@ -32,12 +46,101 @@ namespace vlc {
 	StreamController::sample_type StreamController::MaxSampleValue = SHRT_MAX;
 
 	namespace internal {
+		/**
+		 * One decoded frame in the ring. VLC decodes into slots which are 
+		 * neither published as latest nor read by anyone, so the decoder never
+		 * waits for consumers and consumers never see half-written frames.
+		 */
+		struct FrameSlot
+		{
+			enum State {
+				Free,
+				Decoding,
+				Decoded
+			};
+
+			unsigned char* buffer_ = nullptr;
+			size_t size_ = 0;
+			unsigned width_ = 0, height_ = 0;
+			uint64_t frameNo_ = 0;
+			StreamController::Chroma chroma_ = StreamController::RGBA;
+			unsigned nPlanes_ = 0;
+			unsigned char* planes_[StreamController::MaxPlanes];
+			unsigned pitches_[StreamController::MaxPlanes], lines_[StreamController::MaxPlanes];
+			std::atomic<int> state_;
+			std::atomic<int> readers_;
+
+			FrameSlot() : state_(Free), readers_(0) {}
+		};
+
+		/**
+		 * Transport request. Posted by the cook thread and executed on
+		 * controller's worker thread, as most of these calls may block
+		 * for a long time while VLC tears down its threads.
+		 */
+		struct Command
+		{
+			enum Type {
+				None,
+				Play,
+				Resume,
+				Pause,
+				Stop,
+				Seek,
+				SeekMs,
+				Rate,
+				Volume,
+				Resize,
+				Shutdown
+			};
+
+			Type type_ = None;
+			std::string url_;
+			StreamController::OnRendering onRendering_;
+			StreamController::OnAudioData onAudioData_;
+			// owner is gone, Shutdown is queued. guarded by callbackMutex_
+			bool isShutdownPending_ = false;
+			const void* userData_ = nullptr;
+			float value_ = 0;
+			int64_t timeMs_ = 0;
+		};
+
+		/**
+		 * Numeric part of StreamController::Status, published through 
+		 * a seqlock so that readers don't lock anything
+		 */
+		struct StatusSnapshot
+		{
+			libvlc_state_t state_;
+			bool isVideoInfoReady_, isAudioInfoReady_;
+			StreamController::Status::VideoInfo videoInfo_;
+			StreamController::Status::AudioInfo audioInfo_;
+		};
+
+		struct StreamControllerPrivate;
+
+		/**
+		 * Media being parsed in background. Remembers URL media was opened
+		 * for - cached and in-memory copies have MRLs of their own
+		 */
+		struct MediaInfoRequest
+		{
+			StreamControllerPrivate* controller_;
+			std::string url_;
+			libvlc_media_t* media_;
+		};
+
 		struct StreamControllerPrivate
 		{
 			static std::mutex logMutex_;
 			static FILE* logFile_;
+			// source of strings versions for all controllers, so that
+			// Status refreshed from different controllers never mixes up
+			static std::atomic<uint64_t> lastStringsVersion_;
 
 			std::mutex accessMutex_;
+			// guards callbacks while VLC threads are calling them
+			std::mutex callbackMutex_;
 			libvlc_instance_t* vlcInstance_;
 			libvlc_media_player_t *vlcPlayer_;
 			const void* userData_;
@@ -46,20 +149,80 @@ namespace vlc {
 			int volume = -1;
 			bool volumeChanged = false;
 
-			unsigned char *buffer_ = nullptr;
-
-			unsigned audioBufferSize_ = 0, nAudioSamples_ = 0;
-			StreamController::sample_type* audioBuffer_ = nullptr;
+			std::atomic<int> chroma_;
+			// zero means native size
+			std::atomic<unsigned> maxWidth_, maxHeight_;
+			// size VLC reported for the last format and the one negotiated
+			std::atomic<unsigned> sourceWidth_, sourceHeight_;
+			std::atomic<unsigned> frameWidth_, frameHeight_;
+			std::atomic<uint64_t> maxMemoryClipSize_;
+			// clip VLC reads from RAM - worker thread only
+			std::shared_ptr<const MediaMemory::Buffer> mediaBuffer_;
+			// worker thread only
+			std::unique_ptr<MediaInfoRequest> mediaInfoRequest_;
+			// URL current media was opened for. guarded by accessMutex_
+			std::string mediaUrl_;
+			unsigned nFrameSlots_ = StreamController::DefaultFrameSlots;
+			std::unique_ptr<FrameSlot[]> frameSlots_;
+			// used when every slot is busy - decoded, but never published
+			FrameSlot dropSlot_;
+			std::atomic<int> latestFrame_;
+			std::atomic<uint64_t> nDecodedFrames_, nDroppedFrames_;
+
+			// accessed by VLC's audio thread only
+			StreamController::SampleFormat sampleFormat_ = StreamController::S16;
+			unsigned audioChannels_ = 0;
 
 			StreamController::OnRendering onRendering_;
 			StreamController::OnAudioData onAudioData_;
+			// written with accessMutex_ locked, then published for readers
 			StreamController::Status status_;
+			SeqLock<StatusSnapshot> statusSnapshot_;
+			// pause state queued commands leave player in, -1 if it's whatever
+			// status says. owner's thread only
+			int requestedPause_ = -1;
+			// guards published strings; taken by readers only if version changed
+			std::mutex stringsMutex_;
+			StreamController::Status publishedStrings_;
+			std::atomic<uint64_t> stringsVersion_;
+
+			static const size_t CommandQueueSize = 32;
+			SpscQueue<Command, CommandQueueSize> commands_;
+			// used only to put worker to sleep, never held while calling libvlc
+			std::mutex wakeMutex_;
+			std::condition_variable wakeCondition_;
+			// what was posted last - cook thread only
+			Command::Type lastPostedType_ = Command::None;
+			float lastPostedValue_ = 0;
+			int64_t lastPostedTimeMs_ = 0;
+
+			bool postCommand(Command&& cmd);
+			void runCommands();
+			void executeCommand(Command& cmd);
+			void shutdown();
 
 			void subscribeToEvents(std::initializer_list<libvlc_event_type_t> events);
 			void flushStatus();
+			// fills status from cache or starts parsing media in background
+			void requestMediaInfo(libvlc_media_t* media, const std::string& url);
+			// stops listening to media being parsed for previous play request
+			void cancelMediaInfoRequest();
+			void updateMediaInfo(libvlc_media_t* media, const std::string& url);
+			void applyMediaInfo(const std::string& url, const MediaInfo& info);
+			// both must be called with accessMutex_ locked
+			void publishStatus();
+			void publishStrings();
+
+			void allocateFrames(unsigned width, unsigned height, StreamController::Chroma chroma,
+				unsigned nPlanes, const unsigned* pitches, const unsigned* lines);
+			void freeFrames();
+			FrameSlot* acquireDecodeSlot();
+			void publishFrame(FrameSlot* slot);
+			FrameSlot* pinLatestFrame() const;
 		};
 
 		std::mutex StreamControllerPrivate::logMutex_;
+		std::atomic<uint64_t> StreamControllerPrivate::lastStringsVersion_(0);
 		FILE* StreamControllerPrivate::logFile_ = fopen("yt-streamer.log", "w+");
 	}
 
@@ -89,31 +252,14 @@ namespace vlc {
 #endif
 		}
 
-		void vlcLogCallback(void *data, int level, const libvlc_log_t *ctx, const char *fmt, va_list args)
+		// instance is shared - only messages logged by our player get here
+		void vlcLogCallback(void *data, int level, const char *message)
 		{
 			auto c = reinterpret_cast<internal::StreamControllerPrivate*>(data);
 
-			if (level > LIBVLC_DEBUG)
-			{
-				FILE* outStream = (c->logFile_) ? c->logFile_ : stdout;
-				chrono::system_clock::time_point now = chrono::system_clock::now();
-				chrono::duration<double> seconds = now.time_since_epoch();
-
-				//{
-				//	ScopedLock lock(c->logMutex_);
-				//	fprintf(outStream, "%f <%s-%x-vlc> [%d]\t", seconds, c->name_.c_str(), data, level);
-				//	vfprintf(outStream, fmt, args);
-				//	fprintf(outStream, "\n");
-				//	fflush(outStream);
-				//}
-				{
-					ScopedLock accessLock(c->accessMutex_);
-					static char buf[4096];
-					memset((void*)buf, 0, 256);
-					vsprintf(buf, fmt, args);
-					c->status_.infoString_ = std::string(buf);
-				}
-			}
+			ScopedLock accessLock(c->accessMutex_);
+			c->status_.infoString_ = std::string(message);
+			c->publishStrings();
 		}
 
 		/** 
@@ -124,10 +270,21 @@ namespace vlc {
 		void *lockCB(void *opaque, void **pixelPlane)
 		{
 			auto c = reinterpret_cast<internal::StreamControllerPrivate*>(opaque);
-			ScopedLock lock(c->accessMutex_);
+			internal::FrameSlot* slot = c->acquireDecodeSlot();
 
-			*pixelPlane = c->buffer_;
-			return c->buffer_;
+			for (unsigned i = 0; i < slot->nPlanes_; ++i)
+				pixelPlane[i] = slot->planes_[i];
+
+			return slot;
+		}
+
+		/**
+		* Called when a video frame has been decoded into the slot
+		*/
+		void unlockCB(void *opaque, void *picture, void *const *pixelPlane)
+		{
+			auto slot = reinterpret_cast<internal::FrameSlot*>(picture);
+			slot->state_ = internal::FrameSlot::Decoded;
 		}
 
 		/** 
@@ -136,10 +293,46 @@ namespace vlc {
 		void displayCB(void *opaque, void *picture)
 		{
 			auto c = reinterpret_cast<internal::StreamControllerPrivate*>(opaque);
-			ScopedLock lock(c->accessMutex_);
+			auto slot = reinterpret_cast<internal::FrameSlot*>(picture);
 
+			if (slot == &c->dropSlot_)
+				return;
+
+			c->publishFrame(slot);
+
+			ScopedLock lock(c->callbackMutex_);
 			if (c->onRendering_)
-				c->onRendering_(picture, c->userData_);
+				c->onRendering_(slot->buffer_, c->userData_);
+		}
+
+		/**
+		* Fits source size into max size keeping aspect ratio. Dimensions are 
+		* kept even for subsampled chromas
+		*/
+		void fitResolution(unsigned width, unsigned height, unsigned maxWidth, unsigned maxHeight,
+			unsigned& fitWidth, unsigned& fitHeight)
+		{
+			fitWidth = width;
+			fitHeight = height;
+
+			if (!width || !height)
+				return;
+
+			double scale = 1.;
+
+			if (maxWidth && width > maxWidth)
+				scale = (double)maxWidth / (double)width;
+			if (maxHeight && height * scale > maxHeight)
+				scale = (double)maxHeight / (double)height;
+
+			if (scale < 1.)
+			{
+				fitWidth = (unsigned)(width * scale) & ~1u;
+				fitHeight = (unsigned)(height * scale) & ~1u;
+
+				if (fitWidth < 2) fitWidth = 2;
+				if (fitHeight < 2) fitHeight = 2;
+			}
 		}
 
 		/**
@@ -148,25 +341,74 @@ namespace vlc {
 		unsigned handleFormat(void **opaque, char *chroma, unsigned *width, unsigned *height, unsigned *pitches, unsigned *lines)
 		{
 			auto c = reinterpret_cast<internal::StreamControllerPrivate*>(*opaque);
-			ScopedLock lock(c->accessMutex_);
 			log(c, LIBVLC_DEBUG, "received new video format info", NULL);
 
-			if (c->buffer_)
-				free(c->buffer_);
+			// VLC scales picture to whatever size we return
+			c->sourceWidth_ = *width;
+			c->sourceHeight_ = *height;
+			fitResolution(*width, *height, c->maxWidth_, c->maxHeight_, *width, *height);
+			c->frameWidth_ = *width;
+			c->frameHeight_ = *height;
 
-			c->status_.videoInfo_.frameSize_ = *width*(*height) * 4;
-			c->buffer_ = (unsigned char*)malloc(c->status_.videoInfo_.frameSize_);
+			if (*width != c->sourceWidth_ || *height != c->sourceHeight_)
+				log(c, LIBVLC_DEBUG, "scaling %dx%d down to %dx%d", (unsigned)c->sourceWidth_, 
+					(unsigned)c->sourceHeight_, *width, *height, NULL);
 
-			pitches[0] = pitches[1] = pitches[2] = *width * 4;
-			lines[0] = lines[1] = lines[2] = *height;
-			memcpy((void*)chroma, (void*)"RGBA", 4);
+			StreamController::Chroma frameChroma = (StreamController::Chroma)c->chroma_.load();
+			unsigned nPlanes = 1;
+			// align planar pitches so that converters can use SIMD on every row
+			unsigned alignedWidth = (*width + 31) & ~31;
+			unsigned chromaWidth = alignedWidth / 2, chromaLines = (*height + 1) / 2;
 
+			switch (frameChroma)
+			{
+			case StreamController::I420:
+				nPlanes = 3;
+				pitches[0] = alignedWidth;
+				pitches[1] = pitches[2] = chromaWidth;
+				lines[0] = *height;
+				lines[1] = lines[2] = chromaLines;
+				break;
+			case StreamController::NV12:
+				nPlanes = 2;
+				pitches[0] = pitches[1] = alignedWidth;
+				lines[0] = *height;
+				lines[1] = chromaLines;
+				break;
+			default:
+				frameChroma = StreamController::RGBA;
+				pitches[0] = *width * 4;
+				lines[0] = *height;
+				break;
+			}
+
+			for (unsigned i = nPlanes; i < StreamController::MaxPlanes; ++i)
+			{
+				pitches[i] = 0;
+				lines[i] = 0;
+			}
+
+			std::string chromaStr = StreamController::getChromaString(frameChroma);
+			memcpy((void*)chroma, (void*)chromaStr.c_str(), 4);
+			c->allocateFrames(*width, *height, frameChroma, nPlanes, pitches, lines);
+
+			size_t frameSize = 0;
+			for (unsigned i = 0; i < nPlanes; ++i)
+				frameSize += pitches[i] * lines[i];
+
+			ScopedLock lock(c->accessMutex_);
+			c->status_.videoInfo_.frameSize_ = frameSize;
+			c->status_.videoInfo_.chroma_ = frameChroma;
 			c->status_.videoInfo_.width_ = *width;
 			c->status_.videoInfo_.height_ = *height;
-			c->status_.videoInfo_.totalTime_ = libvlc_media_player_get_length(c->vlcPlayer_);
+			// length may be unknown yet - keep the one from media info then
+			libvlc_time_t length = libvlc_media_player_get_length(c->vlcPlayer_);
+			if (length > 0)
+				c->status_.videoInfo_.totalTime_ = length;
 			c->status_.isVideoInfoReady_ = true;
+			c->publishStatus();
 
-			return 1; // 1 image buffer allocated
+			return c->nFrameSlots_;
 		}
 
 		/**
@@ -175,7 +417,9 @@ namespace vlc {
 		void handleEvent(const libvlc_event_t *e, void *opaque)
 		{
 			auto c = reinterpret_cast<internal::StreamControllerPrivate*>(opaque);
-			ScopedLock lock(c->accessMutex_);
+			std::unique_lock<std::mutex> lock(c->accessMutex_);
+			bool needMediaInfo = false;
+			std::string mediaUrl;
 
 			if (c->volumeChanged) {
 				if (c->volume != libvlc_audio_get_volume(c->vlcPlayer_))
@@ -235,31 +479,10 @@ namespace vlc {
 				log(c, LIBVLC_NOTICE, "new state %s", state.c_str(), NULL);
 				c->status_.state_ = newState;
 
-				if (newState == libvlc_Playing && c->status_.videoInfo_.fps_ == 0)
-				{
-					libvlc_media_t *media = libvlc_media_player_get_media(c->vlcPlayer_);
-
-					if (media)
-					{
-						libvlc_media_track_t **tracks = NULL;
-						static int ntracks = 0;
-
-						libvlc_media_parse(media);
-						ntracks = libvlc_media_tracks_get(media, &tracks);
-
-						for (int i = 0; i < ntracks; i++)
-						{
-							if (tracks[i]->i_type == libvlc_track_video)
-							{
-								c->status_.videoInfo_.fps_ = double(tracks[i]->video->i_frame_rate_num) / double(tracks[i]->video->i_frame_rate_den);
-								break; // we assume 1 video track
-							}
-						}
-
-						if (ntracks && tracks != NULL)
-							libvlc_media_tracks_release(tracks, ntracks);
-					}
-				}
+				// neither cache nor background parsing has delivered yet
+				needMediaInfo = (newState == libvlc_Playing && c->status_.videoInfo_.fps_ == 0);
+				if (needMediaInfo)
+					mediaUrl = c->mediaUrl_;
 			}
 			
 			double progress = (double)e->u.media_player_time_changed.new_time / (double)libvlc_media_player_get_length(c->vlcPlayer_);
@@ -270,6 +493,31 @@ namespace vlc {
 				log(c, LIBVLC_DEBUG, "time %d", libvlc_media_player_get_time(c->vlcPlayer_), NULL);
 
 			c->status_.videoInfo_.currentTime_ = libvlc_media_player_get_time(c->vlcPlayer_);
+			c->publishStatus();
+			lock.unlock();
+
+			// playing input has tracks filled in already - no need to parse
+			if (needMediaInfo)
+			{
+				libvlc_media_t *media = libvlc_media_player_get_media(c->vlcPlayer_);
+
+				if (media)
+				{
+					c->updateMediaInfo(media, mediaUrl);
+					libvlc_media_release(media);
+				}
+			}
+		}
+
+		/**
+		* Handle events coming from media being parsed in background
+		*/
+		void handleMediaEvent(const libvlc_event_t *e, void *opaque)
+		{
+			auto r = reinterpret_cast<internal::MediaInfoRequest*>(opaque);
+
+			if (e->type == libvlc_MediaParsedChanged)
+				r->controller_->updateMediaInfo(r->media_, r->url_);
 		}
 
 		int handleAudioFormat(void **opaque, char *format, unsigned *rate,
@@ -279,13 +527,16 @@ namespace vlc {
 			auto c = reinterpret_cast<internal::StreamControllerPrivate*>(*opaque);
 
 			log(c, LIBVLC_DEBUG, "received new audio format info", NULL);
-			if (c->audioBuffer_)
-			{
-				free(c->audioBuffer_);
-				c->audioBufferSize_ = 0;
-				c->nAudioSamples_ = 0;
-				c->audioBuffer_ = nullptr;
-			}
+
+			// audio memory output of VLC 2.x supports S16N only
+#if LIBVLC_VERSION_INT >= LIBVLC_VERSION(3, 0, 0, 0)
+			memcpy(format, "FL32", 4);
+			c->sampleFormat_ = StreamController::FL32;
+#else
+			memcpy(format, "S16N", 4);
+			c->sampleFormat_ = StreamController::S16;
+#endif
+			c->audioChannels_ = *channels;
 
 			{
 				ScopedLock lock(c->accessMutex_);
@@ -293,6 +544,7 @@ namespace vlc {
 				c->status_.audioInfo_.channels_ = *channels;
 				memcpy(c->status_.audioInfo_.format_, format, 4);
 				c->status_.isAudioInfoReady_ = true;
+				c->publishStatus();
 			}
 #endif
 			return 0;
@@ -303,32 +555,62 @@ namespace vlc {
 #if 1
 			if (count == 0) return;
 
-			// copy audio data
+			// samples are passed to the callback in place, without copying
 			auto c = reinterpret_cast<internal::StreamControllerPrivate*>(opaque);
-			count *= c->status_.audioInfo_.channels_;
-			unsigned bufSize = count * sizeof(StreamController::sample_type);
-
-			if (!c->audioBuffer_ || bufSize > c->audioBufferSize_)
-			{
-				c->nAudioSamples_ = count;
-				c->audioBufferSize_ = bufSize;
-				c->audioBuffer_ = (StreamController::sample_type*)realloc(c->audioBuffer_, c->audioBufferSize_);
-			}
-
-			memcpy(c->audioBuffer_, samples, c->audioBufferSize_);
+			count *= c->audioChannels_;
+			unsigned bufSize = count * (c->sampleFormat_ == StreamController::FL32 ?
+				sizeof(float) : sizeof(StreamController::sample_type));
 
+			ScopedLock lock(c->callbackMutex_);
 			if (c->onAudioData_)
 			{
 				StreamController::AudioData ad;
 
 				ad.audioInfo_ = c->status_.audioInfo_;
-				ad.nSamples_ = c->nAudioSamples_;
-				ad.bufferSize_ = c->audioBufferSize_;
-				ad.buffer_ = c->audioBuffer_;
+				ad.format_ = c->sampleFormat_;
+				ad.nSamples_ = count;
+				ad.bufferSize_ = bufSize;
+				ad.buffer_ = samples;
 				ad.delayUsec_ = libvlc_delay(pts);
 
 				c->onAudioData_(ad, c->userData_);
 			}
+#endif
+		}
+
+		struct WorkerStart
+		{
+			std::shared_ptr<internal::StreamControllerPrivate> d_;
+			// DLL reference the worker releases when it exits
+			void* module_;
+		};
+
+		/**
+		* Controller's worker thread. Owns a reference to private data, so it
+		* outlives StreamController if needed in order to finish shutting down
+		*/
+#ifdef _WIN32
+		DWORD WINAPI commandWorker(LPVOID param)
+#else
+		void commandWorker(void* param)
+#endif
+		{
+			void* module = nullptr;
+
+			{
+				std::unique_ptr<WorkerStart> start(reinterpret_cast<WorkerStart*>(param));
+
+				module = start->module_;
+				start->d_->runCommands();
+			}
+
+#ifdef _WIN32
+			// must not return into the DLL code after releasing it. thread
+			// is ours (not CRT's), so exiting it here skips no cleanup
+			if (module)
+				FreeLibraryAndExitThread((HMODULE)module, 0);
+
+			return 0;
 #endif
 		}
 	}
@@ -341,34 +623,517 @@ namespace vlc {
 			libvlc_event_attach(p_em, event, handleEvent, this);
 	}
 
+	void internal::StreamControllerPrivate::allocateFrames(unsigned width, unsigned height, 
+		StreamController::Chroma chroma, unsigned nPlanes, const unsigned* pitches, const unsigned* lines)
+	{
+		freeFrames();
+
+		size_t frameSize = 0;
+		for (unsigned i = 0; i < nPlanes; ++i)
+			frameSize += pitches[i] * lines[i];
+
+		for (unsigned i = 0; i <= nFrameSlots_; ++i)
+		{
+			FrameSlot& slot = (i < nFrameSlots_ ? frameSlots_[i] : dropSlot_);
+
+			slot.buffer_ = (unsigned char*)malloc(frameSize);
+			slot.size_ = frameSize;
+			slot.width_ = width;
+			slot.height_ = height;
+			slot.chroma_ = chroma;
+			slot.nPlanes_ = nPlanes;
+
+			// all planes share one allocation
+			unsigned char* plane = slot.buffer_;
+			for (unsigned p = 0; p < nPlanes; ++p)
+			{
+				slot.planes_[p] = plane;
+				slot.pitches_[p] = pitches[p];
+				slot.lines_[p] = lines[p];
+				plane += pitches[p] * lines[p];
+			}
+		}
+	}
+
+	void internal::StreamControllerPrivate::freeFrames()
+	{
+		// unpublish latest frame and wait for readers that have pinned it
+		latestFrame_ = -1;
+
+		for (unsigned i = 0; i < nFrameSlots_; ++i)
+		{
+			while (frameSlots_[i].readers_ > 0)
+				std::this_thread::yield();
+
+			if (frameSlots_[i].buffer_)
+				free(frameSlots_[i].buffer_);
+
+			frameSlots_[i].buffer_ = nullptr;
+			frameSlots_[i].size_ = 0;
+			frameSlots_[i].nPlanes_ = 0;
+			frameSlots_[i].state_ = FrameSlot::Free;
+		}
+
+		if (dropSlot_.buffer_)
+			free(dropSlot_.buffer_);
+		dropSlot_.buffer_ = nullptr;
+		dropSlot_.size_ = 0;
+		dropSlot_.nPlanes_ = 0;
+	}
+
+	internal::FrameSlot* internal::StreamControllerPrivate::acquireDecodeSlot()
+	{
+		int latest = latestFrame_;
+
+		for (unsigned i = 0; i < nFrameSlots_; ++i)
+		{
+			FrameSlot& slot = frameSlots_[i];
+			int expected = FrameSlot::Free;
+
+			if ((int)i != latest && slot.readers_ == 0 &&
+				slot.state_.compare_exchange_strong(expected, FrameSlot::Decoding))
+			{
+				// reader could have pinned slot in between - give it back then
+				if (slot.readers_ > 0)
+				{
+					slot.state_ = FrameSlot::Free;
+					continue;
+				}
+
+				slot.frameNo_ = ++nDecodedFrames_;
+				return &slot;
+			}
+		}
+
+		nDroppedFrames_++;
+		return &dropSlot_;
+	}
+
+	void internal::StreamControllerPrivate::publishFrame(FrameSlot* slot)
+	{
+		latestFrame_ = (int)(slot - frameSlots_.get());
+
+		// frames decoded earlier than this one will never be displayed
+		for (unsigned i = 0; i < nFrameSlots_; ++i)
+		{
+			if (&frameSlots_[i] != slot &&
+				frameSlots_[i].state_ == FrameSlot::Decoded &&
+				frameSlots_[i].frameNo_ < slot->frameNo_)
+				frameSlots_[i].state_ = FrameSlot::Free;
+		}
+	}
+
+	internal::FrameSlot* internal::StreamControllerPrivate::pinLatestFrame() const
+	{
+		int latest;
+
+		while ((latest = latestFrame_) >= 0)
+		{
+			FrameSlot& slot = frameSlots_[latest];
+			slot.readers_++;
+
+			// make sure the slot was not unpublished while we were pinning it
+			if (latest == latestFrame_)
+				return &slot;
+
+			slot.readers_--;
+		}
+
+		return nullptr;
+	}
+
+	bool internal::StreamControllerPrivate::postCommand(Command&& cmd)
+	{
+		// repeating request which is still queued would change nothing
+		if (cmd.type_ != Command::Play && !commands_.empty() &&
+			cmd.type_ == lastPostedType_ && 
+			cmd.value_ == lastPostedValue_ && 
+			cmd.timeMs_ == lastPostedTimeMs_)
+			return true;
+
+		Command::Type type = cmd.type_;
+		float value = cmd.value_;
+		int64_t timeMs = cmd.timeMs_;
+
+		if (!commands_.push(std::move(cmd)))
+		{
+			log(this, LIBVLC_WARNING, "command queue is full. dropping command %d", type, NULL);
+			return false;
+		}
+
+		lastPostedType_ = type;
+		lastPostedValue_ = value;
+		lastPostedTimeMs_ = timeMs;
+
+		// worker checks the queue with wakeMutex_ locked, so it either sees
+		// the command or is already waiting when notified
+		{
+			ScopedLock lock(wakeMutex_);
+		}
+		wakeCondition_.notify_one();
+
+		return true;
+	}
+
+	void internal::StreamControllerPrivate::runCommands()
+	{
+		Command cmd;
+
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(wakeMutex_);
+				wakeCondition_.wait(lock, [this](){ return !commands_.empty(); });
+			}
+
+			while (commands_.pop(cmd))
+			{
+				if (cmd.type_ == Command::Shutdown)
+				{
+					shutdown();
+					return;
+				}
+
+				executeCommand(cmd);
+			}
+		}
+	}
+
+	void internal::StreamControllerPrivate::executeCommand(Command& cmd)
+	{
+		switch (cmd.type_)
+		{
+		case Command::Play:
+		{
+			log(this, LIBVLC_DEBUG, "executing play request for URL %s", cmd.url_.c_str(), NULL);
+			libvlc_media_player_stop(vlcPlayer_);
+
+			bool isShutdownPending;
+			{
+				ScopedLock lock(callbackMutex_);
+				isShutdownPending = isShutdownPending_;
+
+				// callbacks queued with the request are bound to the owner
+				if (!isShutdownPending)
+				{
+					onRendering_ = cmd.onRendering_;
+					onAudioData_ = cmd.onAudioData_;
+					userData_ = cmd.userData_;
+				}
+			}
+
+			if (isShutdownPending)
+				break;
+			{
+				// drop whatever stopping media reported after play was requested
+				ScopedLock lock(accessMutex_);
+				flushStatus();
+				mediaUrl_ = cmd.url_;
+			}
+
+			// loops and handovers play the same URLs over and over again
+			std::string path;
+			libvlc_media_t *media = nullptr;
+			// player has stopped and parsing is cancelled - nothing reads
+			// previous clip anymore
+			cancelMediaInfoRequest();
+			mediaBuffer_.reset();
+
+			if (MediaCache::lookup(cmd.url_, path))
+			{
+#if LIBVLC_VERSION_INT >= LIBVLC_VERSION(3, 0, 0, 0)
+				if (maxMemoryClipSize_ && 
+					(mediaBuffer_ = MediaMemory::load(cmd.url_, path, maxMemoryClipSize_)))
+				{
+					log(this, LIBVLC_DEBUG, "playing %s from memory", cmd.url_.c_str(), NULL);
+					media = MediaMemory::newMedia(vlcInstance_, mediaBuffer_.get());
+				}
+#endif
+				if (!media)
+				{
+					log(this, LIBVLC_DEBUG, "playing cached copy %s", path.c_str(), NULL);
+					media = libvlc_media_new_path(vlcInstance_, path.c_str());
+				}
+			}
+			else
+			{
+				media = libvlc_media_new_location(vlcInstance_, cmd.url_.c_str());
+				MediaCache::fetch(cmd.url_);
+			}
+
+			requestMediaInfo(media, cmd.url_);
+			libvlc_media_player_set_media(vlcPlayer_, media);
+			libvlc_media_release(media);
+			libvlc_media_player_play(vlcPlayer_);
+
+			log(this, LIBVLC_DEBUG, "set player for playback...", NULL);
+		}
+			break;
+		case Command::Resume:
+		{
+			{
+				// nothing would receive frames anyway
+				ScopedLock lock(callbackMutex_);
+				if (isShutdownPending_)
+					break;
+			}
+
+			int res = libvlc_media_player_play(vlcPlayer_);
+			log(this, LIBVLC_NOTICE, "resume playback request: %d", res, NULL);
+		}
+			break;
+		case Command::Pause:
+			log(this, LIBVLC_NOTICE, "pause playback request %d", (cmd.value_ != 0), NULL);
+			libvlc_media_player_set_pause(vlcPlayer_, (cmd.value_ != 0));
+			break;
+		case Command::Stop:
+		{
+			libvlc_media_player_stop(vlcPlayer_);
+			// parser may still read clip from RAM
+			cancelMediaInfoRequest();
+			mediaBuffer_.reset();
+
+			ScopedLock lock(accessMutex_);
+			flushStatus();
+			mediaUrl_.clear();
+		}
+			break;
+		case Command::Seek:
+		{
+			if (libvlc_media_player_is_seekable(vlcPlayer_))
+			{
+				float curPos = round(libvlc_media_player_get_position(vlcPlayer_) * 100) / 100;
+				if (round(cmd.value_ * 100) / 100 != curPos)
+				{
+					log(this, LIBVLC_NOTICE, "seek to position %.2f", cmd.value_, NULL);
+					libvlc_media_player_set_position(vlcPlayer_, cmd.value_);
+				}
+			}
+			else
+				log(this, LIBVLC_WARNING, "media is not seekable", NULL);
+		}
+			break;
+		case Command::SeekMs:
+		{
+			if (libvlc_media_player_is_seekable(vlcPlayer_))
+			{
+				libvlc_time_t curTime = libvlc_media_player_get_time(vlcPlayer_);
+
+				if (curTime != cmd.timeMs_)
+				{
+					log(this, LIBVLC_NOTICE, "set time to %d", cmd.timeMs_, NULL);
+					libvlc_media_player_set_time(vlcPlayer_, cmd.timeMs_);
+				}
+			}
+			else
+				log(this, LIBVLC_WARNING, "media is not seekable", NULL);
+		}
+			break;
+		case Command::Rate:
+			log(this, LIBVLC_NOTICE, "set playback speed to %.2f", cmd.value_, NULL);
+			libvlc_media_player_set_rate(vlcPlayer_, cmd.value_);
+			break;
+		case Command::Volume:
+		{
+			log(this, LIBVLC_NOTICE, "set volume request", NULL);
+
+			{
+				ScopedLock lock(accessMutex_);
+				volume = (int)cmd.value_;
+				volumeChanged = true;
+			}
+
+			if (libvlc_audio_get_volume(vlcPlayer_) != -1)
+				libvlc_audio_set_volume(vlcPlayer_, (int)cmd.value_);
+		}
+			break;
+		case Command::Resize:
+		{
+			// format is negotiated only when video output starts, so restart
+			// current media where it is. other states pick new size on their own
+			libvlc_state_t state = libvlc_media_player_get_state(vlcPlayer_);
+
+			if (state != libvlc_Playing && state != libvlc_Paused)
+				break;
+
+			libvlc_media_t *media = libvlc_media_player_get_media(vlcPlayer_);
+
+			if (!media)
+				break;
+
+			libvlc_time_t timeMs = libvlc_media_player_get_time(vlcPlayer_);
+			log(this, LIBVLC_NOTICE, "renegotiating video format at %d", timeMs, NULL);
+
+			libvlc_media_player_stop(vlcPlayer_);
+			libvlc_media_player_set_media(vlcPlayer_, media);
+			libvlc_media_release(media);
+			libvlc_media_player_play(vlcPlayer_);
+
+			if (timeMs > 0)
+				libvlc_media_player_set_time(vlcPlayer_, timeMs);
+			if (state == libvlc_Paused)
+				libvlc_media_player_set_pause(vlcPlayer_, 1);
+		}
+			break;
+		default:
+			break;
+		}
+	}
+
+	void internal::StreamControllerPrivate::shutdown()
+	{
+		libvlc_media_player_stop(vlcPlayer_);
+		cancelMediaInfoRequest();
+		libvlc_media_player_release(vlcPlayer_);
+		log(this, LIBVLC_NOTICE, "released player instance", NULL);
+
+		// log callback locks accessMutex_ - return instance before taking it
+		InstancePool::release(vlcInstance_, this);
+		log(this, LIBVLC_NOTICE, "returned VLC library instance to the pool", NULL);
+
+		{
+			ScopedLock lock(accessMutex_);
+
+			fclose(logFile_);
+
+			freeFrames();
+		}
+	}
+
 	void internal::StreamControllerPrivate::flushStatus()
 	{
 		status_.isVideoInfoReady_ = false;
 		status_.isAudioInfoReady_ = false;
 		status_.state_ = libvlc_NothingSpecial;
-		status_.videoUrl_ = "";
 		status_.videoInfo_.bufferLevel_ = 0;
 		status_.videoInfo_.currentTime_ = 0;
 		status_.videoInfo_.height_ = 0;
 		status_.videoInfo_.width_ = 0;
 		status_.videoInfo_.totalTime_ = 0;
 		status_.videoInfo_.fps_ = 0;
+		status_.videoInfo_.frameSize_ = 0;
+		status_.videoInfo_.chroma_ = (StreamController::Chroma)chroma_.load();
+		publishStatus();
 	}
 
-	StreamController::StreamController(std::string name)
-		: d_(new internal::StreamControllerPrivate)
+	void internal::StreamControllerPrivate::requestMediaInfo(libvlc_media_t* media, const std::string& url)
 	{
-		static const int nArgs = 1;
-		static const char *libVlcArgs[nArgs] = { "--network-caching=20000" };
+		MediaInfo info;
 
- 		d_->flushStatus();
-		d_->name_ = name;
-		d_->vlcInstance_ = libvlc_new(nArgs, libVlcArgs);
+		if (MediaInfoCache::lookup(url, info))
+		{
+			log(this, LIBVLC_DEBUG, "media info is cached for %s", url.c_str(), NULL);
+			applyMediaInfo(url, info);
+		}
+		else
+		{
+			// MRL of media may differ from URL, so request keeps the URL
+			mediaInfoRequest_.reset(new MediaInfoRequest{ this, url, media });
+			libvlc_media_retain(media);
+			libvlc_event_attach(libvlc_media_event_manager(media), libvlc_MediaParsedChanged, 
+				handleMediaEvent, mediaInfoRequest_.get());
+			libvlc_media_parse_async(media);
+		}
+	}
+
+	void internal::StreamControllerPrivate::cancelMediaInfoRequest()
+	{
+		if (!mediaInfoRequest_)
+			return;
+
+#if LIBVLC_VERSION_INT >= LIBVLC_VERSION(3, 0, 0, 0)
+		// parser reads media (maybe a clip in RAM) until it's stopped
+		libvlc_media_parse_stop(mediaInfoRequest_->media_);
+#endif
+		// waits for handler if it's running
+		libvlc_event_detach(libvlc_media_event_manager(mediaInfoRequest_->media_), 
+			libvlc_MediaParsedChanged, handleMediaEvent, mediaInfoRequest_.get());
+		libvlc_media_release(mediaInfoRequest_->media_);
+		mediaInfoRequest_.reset();
+	}
+
+	void internal::StreamControllerPrivate::updateMediaInfo(libvlc_media_t* media, const std::string& url)
+	{
+		MediaInfo info;
+
+		if (!url.empty() && MediaInfoCache::read(media, info))
+		{
+			MediaInfoCache::store(url, info);
+			applyMediaInfo(url, info);
+		}
+	}
+
+	void internal::StreamControllerPrivate::applyMediaInfo(const std::string& url, const MediaInfo& info)
+	{
+		ScopedLock lock(accessMutex_);
+
+		// controller may have moved on to another URL meanwhile
+		if (status_.videoUrl_ != url)
+			return;
+
+		if (info.fps_ > 0)
+			status_.videoInfo_.fps_ = info.fps_;
+		if (info.duration_ > 0 && status_.videoInfo_.totalTime_ <= 0)
+			status_.videoInfo_.totalTime_ = info.duration_;
+
+		// decoded format, once known, is what frames really have
+		if (!status_.isVideoInfoReady_ && info.width_ && info.height_)
+		{
+			status_.videoInfo_.width_ = info.width_;
+			status_.videoInfo_.height_ = info.height_;
+		}
+
+		publishStatus();
+	}
+
+	void internal::StreamControllerPrivate::publishStatus()
+	{
+		StatusSnapshot snapshot;
+
+		memset(&snapshot, 0, sizeof(snapshot));
+		snapshot.state_ = status_.state_;
+		snapshot.isVideoInfoReady_ = status_.isVideoInfoReady_;
+		snapshot.isAudioInfoReady_ = status_.isAudioInfoReady_;
+		snapshot.videoInfo_ = status_.videoInfo_;
+		snapshot.audioInfo_ = status_.audioInfo_;
+
+		statusSnapshot_.store(snapshot);
+	}
+
+	void internal::StreamControllerPrivate::publishStrings()
+	{
+		ScopedLock lock(stringsMutex_);
+
+		publishedStrings_.videoUrl_ = status_.videoUrl_;
+		publishedStrings_.warningMessage_ = status_.warningMessage_;
+		publishedStrings_.errorMessage_ = status_.errorMessage_;
+		publishedStrings_.infoString_ = status_.infoString_;
+		stringsVersion_ = ++lastStringsVersion_;
+	}
+
+	StreamController::StreamController(std::string name, unsigned nFrameSlots)
+		: d_(new internal::StreamControllerPrivate)
+	{
+ 		d_->name_ = name;
+		d_->nFrameSlots_ = (nFrameSlots ? nFrameSlots : 1);
+		d_->frameSlots_.reset(new internal::FrameSlot[d_->nFrameSlots_]);
+		d_->latestFrame_ = -1;
+		d_->chroma_ = RGBA;
+		d_->maxWidth_ = d_->maxHeight_ = 0;
+		d_->sourceWidth_ = d_->sourceHeight_ = 0;
+		d_->frameWidth_ = d_->frameHeight_ = 0;
+		d_->maxMemoryClipSize_ = MediaMemory::DefaultMaxSize;
+		d_->nDecodedFrames_ = 0;
+		d_->nDroppedFrames_ = 0;
+		d_->flushStatus();
+		d_->publishStrings();
+		d_->vlcInstance_ = InstancePool::acquire();
 
 		if (d_->vlcInstance_)
 		{
-			libvlc_log_set(d_->vlcInstance_, &vlcLogCallback, d_.get());
 			d_->vlcPlayer_ = libvlc_media_player_new(d_->vlcInstance_);
+			// player is VLC object itself, it's what log context refers to
+			InstancePool::listen(d_->vlcInstance_, d_->vlcPlayer_, &vlcLogCallback, d_.get());
 			log(d_.get(), LIBVLC_DEBUG, "created new player instance", NULL);
 
 			d_->subscribeToEvents({
@@ -384,127 +1149,198 @@ namespace vlc {
 				libvlc_MediaPlayerMediaChanged
 			});
 
-			libvlc_video_set_callbacks(d_->vlcPlayer_, &lockCB, NULL /*unlock*/, &displayCB, d_.get());
+			libvlc_video_set_callbacks(d_->vlcPlayer_, &lockCB, &unlockCB, &displayCB, d_.get());
 			libvlc_video_set_format_callbacks(d_->vlcPlayer_, handleFormat, NULL);
 			libvlc_audio_set_callbacks(d_->vlcPlayer_, &audioPlay, NULL, NULL, NULL, NULL, d_.get());
 			libvlc_audio_set_format_callbacks(d_->vlcPlayer_, &handleAudioFormat, NULL);
 		}
 		else
 			throw std::exception("Couldn't initialize VLC instance");
+
+		WorkerStart* start = new WorkerStart{ d_, nullptr };
+#ifdef _WIN32
+		// worker may outlive this object - don't let DLL unload under it
+		GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, 
+			(LPCTSTR)&commandWorker, (HMODULE*)&start->module_);
+
+		HANDLE worker = CreateThread(NULL, 0, &commandWorker, start, 0, NULL);
+
+		if (!worker)
+		{
+			if (start->module_)
+				FreeLibrary((HMODULE)start->module_);
+			delete start;
+
+			libvlc_media_player_release(d_->vlcPlayer_);
+			InstancePool::release(d_->vlcInstance_, d_.get());
+			throw std::exception("Couldn't start controller's worker thread");
+		}
+
+		CloseHandle(worker);
+#else
+		std::thread(&commandWorker, start).detach();
+#endif
 	}
 
 	StreamController::~StreamController()
 	{
-		libvlc_media_player_stop(d_->vlcPlayer_);
+		log(d_.get(), LIBVLC_NOTICE, "shutting down", NULL);
 
+		// whoever gave us callbacks may be gone once we return. queued
+		// play requests mustn't install theirs again
 		{
-			ScopedLock lock(d_->accessMutex_);
-
-			libvlc_media_player_release(d_->vlcPlayer_);
-			log(d_.get(), LIBVLC_NOTICE, "released player instance", NULL);
-			libvlc_log_unset(d_->vlcInstance_);
-			libvlc_release(d_->vlcInstance_);
-			log(d_.get(), LIBVLC_NOTICE, "released VLC library instance", NULL);
+			ScopedLock lock(d_->callbackMutex_);
+			d_->isShutdownPending_ = true;
+			d_->onRendering_ = nullptr;
+			d_->onAudioData_ = nullptr;
+		}
 
-			fclose(d_->logFile_);
+		// worker stops and releases the player and keeps private data
+		// alive until it's done, so destruction doesn't block the caller
+		internal::Command cmd;
+		cmd.type_ = internal::Command::Shutdown;
 
-			if (d_->buffer_)
-				free(d_->buffer_);
-			if (d_->audioBuffer_)
-				free(d_->audioBuffer_);
+		while (!d_->postCommand(std::move(cmd)))
+		{
+			cmd.type_ = internal::Command::Shutdown;
+			std::this_thread::yield();
 		}
 	}
+
 	void StreamController::play(const std::string& url, OnRendering onRendering,
 		OnAudioData onAudioData, const void* userData)
 	{
 		log(d_.get(), LIBVLC_NOTICE, "play request for URL %s", url.c_str(), NULL);
-		libvlc_media_player_stop(d_->vlcPlayer_);
+		d_->requestedPause_ = -1;
 
-		d_->flushStatus();
-		d_->onRendering_ = onRendering;
-		d_->onAudioData_ = onAudioData;
-		d_->userData_ = userData;
-		d_->status_.videoUrl_ = url;
-
-		libvlc_media_t *media = libvlc_media_new_location(d_->vlcInstance_, url.c_str());
-
-		libvlc_media_player_set_media(d_->vlcPlayer_, media);
-		libvlc_media_release(media);
-		libvlc_media_player_play(d_->vlcPlayer_);
+		{
+			ScopedLock lock(d_->accessMutex_);
+			d_->flushStatus();
+			d_->status_.videoUrl_ = url;
+			d_->publishStrings();
+		}
 
-		log(d_.get(), LIBVLC_DEBUG, "set player for playback...", NULL);
+		internal::Command cmd;
+		cmd.type_ = internal::Command::Play;
+		cmd.url_ = url;
+		cmd.onRendering_ = onRendering;
+		cmd.onAudioData_ = onAudioData;
+		cmd.userData_ = userData;
+		d_->postCommand(std::move(cmd));
 	}
 
 	void StreamController::play()
 	{
-		int res = libvlc_media_player_play(d_->vlcPlayer_);
-		log(d_.get(), LIBVLC_NOTICE, "resume playback request: %d", res, NULL);
+		d_->requestedPause_ = -1;
+
+		internal::Command cmd;
+		cmd.type_ = internal::Command::Resume;
+		d_->postCommand(std::move(cmd));
 	}
 
 	void StreamController::pause(bool on)
 	{
-		bool isPaused = (libvlc_Paused == d_->status_.state_);
+		// status lags behind queue - pause(false) right after pause(true)
+		// must not be taken for a repeated request
+		bool isPaused = (d_->requestedPause_ >= 0 ? d_->requestedPause_ != 0 :
+			libvlc_Paused == d_->statusSnapshot_.load().state_);
 
 		if (isPaused ^ on)
 		{
-			log(d_.get(), LIBVLC_NOTICE, "pause playback request %d", on, NULL);
-			libvlc_media_player_set_pause(d_->vlcPlayer_, on);
+			internal::Command cmd;
+			cmd.type_ = internal::Command::Pause;
+			cmd.value_ = (on ? 1.f : 0.f);
+			d_->postCommand(std::move(cmd));
 		}
+
+		d_->requestedPause_ = (on ? 1 : 0);
 	}
 
 	void StreamController::stop()
 	{
 		log(d_.get(), LIBVLC_NOTICE, "stop playback request", NULL);
-		libvlc_media_player_stop(d_->vlcPlayer_);
-		d_->flushStatus();
+		d_->requestedPause_ = -1;
+
+		{
+			ScopedLock lock(d_->accessMutex_);
+			d_->flushStatus();
+			d_->status_.videoUrl_ = "";
+			d_->publishStrings();
+		}
+
+		internal::Command cmd;
+		cmd.type_ = internal::Command::Stop;
+		d_->postCommand(std::move(cmd));
 	}
 
 	void StreamController::seek(float pos)
 	{
-		if (libvlc_media_player_is_seekable(d_->vlcPlayer_))
-		{
-			float curPos = round(libvlc_media_player_get_position(d_->vlcPlayer_)*100)/100;
-			if (round(pos*100)/100 != curPos)
-			{
-				log(d_.get(), LIBVLC_NOTICE, "seek to position %.2f", pos, NULL);
-				libvlc_media_player_set_position(d_->vlcPlayer_, pos);
-			}
-		}
-		else
-			log(d_.get(), LIBVLC_WARNING, "media is not seekable", NULL);
+		internal::Command cmd;
+		cmd.type_ = internal::Command::Seek;
+		cmd.value_ = pos;
+		d_->postCommand(std::move(cmd));
 	}
 
 	void StreamController::seekMs(int64_t timeMs)
 	{
-		if (libvlc_media_player_is_seekable(d_->vlcPlayer_))
-		{
-			libvlc_time_t curTime = libvlc_media_player_get_time(d_->vlcPlayer_);
-			
-			if (curTime != timeMs)
-			{
-				log(d_.get(), LIBVLC_NOTICE, "set time to %d", timeMs, NULL);
-				libvlc_media_player_set_time(d_->vlcPlayer_, timeMs);
-			}
-		}
-		else
-			log(d_.get(), LIBVLC_WARNING, "media is not seekable", NULL);
+		internal::Command cmd;
+		cmd.type_ = internal::Command::SeekMs;
+		cmd.timeMs_ = timeMs;
+		d_->postCommand(std::move(cmd));
 	}
 
 	void StreamController::setPlaybackSpeed(float speed)
 	{
-		log(d_.get(), LIBVLC_NOTICE, "set playback speed to %.2f", speed, NULL);
-		libvlc_media_player_set_rate(d_->vlcPlayer_, speed);
+		internal::Command cmd;
+		cmd.type_ = internal::Command::Rate;
+		cmd.value_ = speed;
+		d_->postCommand(std::move(cmd));
 	}
 
 	void StreamController::setVolume(int volume)
 	{
-		log(d_.get(), LIBVLC_NOTICE, "set volume request", NULL);
+		internal::Command cmd;
+		cmd.type_ = internal::Command::Volume;
+		cmd.value_ = (float)volume;
+		d_->postCommand(std::move(cmd));
+	}
+
+	void StreamController::setChroma(Chroma chroma)
+	{
+		if (d_->chroma_ != chroma)
+		{
+			log(d_.get(), LIBVLC_NOTICE, "set chroma to %s", getChromaString(chroma).c_str(), NULL);
+			d_->chroma_ = chroma;
+		}
+	}
+
+	void StreamController::setMaxResolution(unsigned maxWidth, unsigned maxHeight)
+	{
+		if (d_->maxWidth_ == maxWidth && d_->maxHeight_ == maxHeight)
+			return;
+
+		d_->maxWidth_ = maxWidth;
+		d_->maxHeight_ = maxHeight;
 
-		d_->volume = volume;
-		d_->volumeChanged = true;
+		// nothing to renegotiate if current frames would keep their size
+		unsigned width, height;
+		fitResolution(d_->sourceWidth_, d_->sourceHeight_, maxWidth, maxHeight, width, height);
 
-		if (libvlc_audio_get_volume(d_->vlcPlayer_) != -1)
-			libvlc_audio_set_volume(d_->vlcPlayer_, volume);
+		if (width == d_->frameWidth_ && height == d_->frameHeight_)
+			return;
+
+		log(d_.get(), LIBVLC_NOTICE, "set max resolution to %dx%d", maxWidth, maxHeight, NULL);
+
+		internal::Command cmd;
+		cmd.type_ = internal::Command::Resize;
+		cmd.value_ = (float)width;
+		cmd.timeMs_ = height;
+		d_->postCommand(std::move(cmd));
+	}
+
+	void StreamController::setMaxMemoryClipSize(uint64_t maxSize)
+	{
+		d_->maxMemoryClipSize_ = maxSize;
 	}
 
 	libvlc_state_t StreamController::getState() const
@@ -514,11 +1350,124 @@ namespace vlc {
 
 	const StreamController::Status StreamController::getStatus() const
 	{
-		ScopedLock lock(d_->accessMutex_);
-		StreamController::Status status = d_->status_;
+		StreamController::Status status;
+		getStatus(status);
 		return status;
 	}
 
+	void StreamController::getStatus(Status& status) const
+	{
+		internal::StatusSnapshot snapshot = d_->statusSnapshot_.load();
+
+		status.state_ = snapshot.state_;
+		status.isVideoInfoReady_ = snapshot.isVideoInfoReady_;
+		status.isAudioInfoReady_ = snapshot.isAudioInfoReady_;
+		status.videoInfo_ = snapshot.videoInfo_;
+		status.audioInfo_ = snapshot.audioInfo_;
+		status.nPendingCommands_ = (unsigned)d_->commands_.size();
+
+		if (status.stringsVersion_ != d_->stringsVersion_.load())
+		{
+			ScopedLock lock(d_->stringsMutex_);
+
+			status.videoUrl_ = d_->publishedStrings_.videoUrl_;
+			status.warningMessage_ = d_->publishedStrings_.warningMessage_;
+			status.errorMessage_ = d_->publishedStrings_.errorMessage_;
+			status.infoString_ = d_->publishedStrings_.infoString_;
+			status.stringsVersion_ = d_->stringsVersion_;
+		}
+	}
+
+	StreamController::FrameRef StreamController::getLatestFrame() const
+	{
+		return FrameRef(d_->pinLatestFrame());
+	}
+
+	StreamController::FrameRef::FrameRef() : slot_(nullptr) {}
+
+	StreamController::FrameRef::FrameRef(internal::FrameSlot* pinnedSlot) : slot_(pinnedSlot) {}
+
+	StreamController::FrameRef::FrameRef(const FrameRef& other) : slot_(other.slot_)
+	{
+		if (slot_)
+			slot_->readers_++;
+	}
+
+	StreamController::FrameRef::~FrameRef()
+	{
+		release();
+	}
+
+	StreamController::FrameRef& StreamController::FrameRef::operator=(const FrameRef& other)
+	{
+		if (this != &other)
+		{
+			if (other.slot_)
+				other.slot_->readers_++;
+			release();
+			slot_ = other.slot_;
+		}
+
+		return *this;
+	}
+
+	void StreamController::FrameRef::release()
+	{
+		if (slot_)
+			slot_->readers_--;
+		slot_ = nullptr;
+	}
+
+	const unsigned char* StreamController::FrameRef::data() const
+	{
+		return (slot_ ? slot_->buffer_ : nullptr);
+	}
+
+	size_t StreamController::FrameRef::size() const
+	{
+		return (slot_ ? slot_->size_ : 0);
+	}
+
+	unsigned StreamController::FrameRef::width() const
+	{
+		return (slot_ ? slot_->width_ : 0);
+	}
+
+	unsigned StreamController::FrameRef::height() const
+	{
+		return (slot_ ? slot_->height_ : 0);
+	}
+
+	uint64_t StreamController::FrameRef::frameNo() const
+	{
+		return (slot_ ? slot_->frameNo_ : 0);
+	}
+
+	StreamController::Chroma StreamController::FrameRef::chroma() const
+	{
+		return (slot_ ? slot_->chroma_ : RGBA);
+	}
+
+	unsigned StreamController::FrameRef::nPlanes() const
+	{
+		return (slot_ ? slot_->nPlanes_ : 0);
+	}
+
+	const unsigned char* StreamController::FrameRef::plane(unsigned idx) const
+	{
+		return (slot_ && idx < slot_->nPlanes_ ? slot_->planes_[idx] : nullptr);
+	}
+
+	unsigned StreamController::FrameRef::pitch(unsigned idx) const
+	{
+		return (slot_ && idx < slot_->nPlanes_ ? slot_->pitches_[idx] : 0);
+	}
+
+	unsigned StreamController::FrameRef::lines(unsigned idx) const
+	{
+		return (slot_ && idx < slot_->nPlanes_ ? slot_->lines_[idx] : 0);
+	}
+
 	std::string StreamController::getStateString(libvlc_state_t state)
 	{
 		switch (state)
@@ -545,4 +1494,21 @@ namespace vlc {
 
 		return "Unknown";
 	}
+
+	std::string StreamController::getChromaString(Chroma chroma)
+	{
+		// these are VLC's fourcc codes
+		switch (chroma)
+		{
+		case I420:
+			return "I420";
+		case NV12:
+			return "NV12";
+		case RGBA:
+		default:
+			break;
+		}
+
+		return "RGBA";
+	}
 }
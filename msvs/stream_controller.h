@@ -33,18 +33,31 @@ typedef std::lock_guard<std::mutex> ScopedLock;
 namespace vlc {
 	namespace internal {
 		struct StreamControllerPrivate;
+		struct FrameSlot;
 	}
 
 	class StreamController {
 	public:
+		// pixel format VLC is asked to decode into
+		typedef enum _Chroma {
+			RGBA,	// packed, 4 bytes per pixel
+			I420,	// planar Y, U, V; chroma subsampled 2x2
+			NV12	// planar Y, interleaved UV; chroma subsampled 2x2
+		} Chroma;
+
+		static const unsigned MaxPlanes = 3;
+
 		class Status {
 		public:
+			Status() : stringsVersion_(0) {}
+
 			struct VideoInfo {
 				unsigned width_, height_;
 				int64_t totalTime_, currentTime_;
 				double bufferLevel_;
 				size_t frameSize_;
 				double fps_;
+				Chroma chroma_;
 			};
 
 			struct AudioInfo {
@@ -53,31 +66,88 @@ namespace vlc {
 			};
 
 			libvlc_state_t state_;
+			// transport commands which haven't been executed yet
+			unsigned nPendingCommands_;
 			std::string videoUrl_;
 			bool isVideoInfoReady_, isAudioInfoReady_;
 			VideoInfo videoInfo_;
 			AudioInfo audioInfo_;
 			std::string warningMessage_, errorMessage_, infoString_;
+			// version of string fields above, unique across all controllers
+			uint64_t stringsVersion_;
 		};
 
+		// audio sample format VLC is asked to output
+		typedef enum _SampleFormat {
+			S16,	// signed 16-bit integer, native endianness
+			FL32	// 32-bit float in -1..1 range
+		} SampleFormat;
+
 		typedef int16_t sample_type;
 		static sample_type MaxSampleValue;
 
 		struct AudioData {
-			AudioData():nSamples_(0), bufferSize_(0), buffer_(nullptr) {}
+			AudioData():format_(S16), nSamples_(0), bufferSize_(0), buffer_(nullptr) {}
 			Status::AudioInfo audioInfo_;
+			SampleFormat format_;
+			// number of interleaved samples of all channels
 			unsigned nSamples_;
 			unsigned bufferSize_;
 			uint64_t delayUsec_;
-			sample_type* buffer_;
+			// VLC's buffer, valid only during the callback
+			const void* buffer_;
+		};
+
+		/**
+		 * Reference-counted handle to a decoded frame. While at least one
+		 * handle exists, the decoder will not reuse frame's memory, so the
+		 * frame can be uploaded straight from it without copying.
+		 */
+		class FrameRef {
+		public:
+			FrameRef();
+			FrameRef(const FrameRef& other);
+			~FrameRef();
+			FrameRef& operator=(const FrameRef& other);
+
+			explicit operator bool() const { return slot_ != nullptr; }
+
+			const unsigned char* data() const;
+			size_t size() const;
+			unsigned width() const;
+			unsigned height() const;
+			uint64_t frameNo() const;
+
+			Chroma chroma() const;
+			unsigned nPlanes() const;
+			const unsigned char* plane(unsigned idx) const;
+			unsigned pitch(unsigned idx) const;
+			unsigned lines(unsigned idx) const;
+
+			void release();
+
+		private:
+			friend class StreamController;
+			explicit FrameRef(internal::FrameSlot* pinnedSlot);
+
+			internal::FrameSlot* slot_;
 		};
 
 		typedef std::function<void(const void*, const void* userData)> OnRendering;
 		typedef std::function<void(const AudioData, const void* userData)> OnAudioData;
 
-		StreamController(std::string name = "StreamController");
+		// number of decoded frame slots VLC rotates through
+		static const unsigned DefaultFrameSlots = 3;
+
+		StreamController(std::string name = "StreamController", 
+			unsigned nFrameSlots = DefaultFrameSlots);
 		~StreamController();
 
+		/**
+		 * Transport calls below don't block: they are queued and executed
+		 * in order on controller's worker thread. Until then, 
+		 * Status::nPendingCommands_ is non-zero.
+		 */
 		void play(const std::string& url, OnRendering onRendering, 
 			OnAudioData onAudioData, const void* userData);
 		void play();
@@ -89,10 +159,45 @@ namespace vlc {
 
 		void setVolume(int volume);
 
+		/**
+		 * Sets pixel format for decoded frames. Takes effect when VLC 
+		 * negotiates video format next time (i.e. on next play request).
+		 */
+		void setChroma(Chroma chroma);
+
+		/**
+		 * Bounds size of decoded frames - VLC scales pictures down to fit
+		 * into maxWidth x maxHeight, keeping aspect ratio. Zero means native
+		 * size. If it changes size of current stream, format is negotiated
+		 * again on worker thread and playback continues from current time.
+		 */
+		void setMaxResolution(unsigned maxWidth, unsigned maxHeight);
+
+		/**
+		 * Clips cached on disk which are no larger than this are played 
+		 * from RAM (with libvlc 3.0 and later). Zero turns it off. Takes
+		 * effect on next play request.
+		 */
+		void setMaxMemoryClipSize(uint64_t maxSize);
+
 		libvlc_state_t getState() const;
 		const Status getStatus() const;
+		/**
+		 * Refreshes status without locking. String fields are copied only
+		 * if they've changed since status was refreshed last time.
+		 */
+		void getStatus(Status& status) const;
+
+		/**
+		 * Returns handle to the latest completely decoded frame. Never blocks 
+		 * decoding thread. Returned handle is empty if there is no frame 
+		 * available yet. Handles should not be held longer than needed for 
+		 * upload - format changes wait for them to be released.
+		 */
+		FrameRef getLatestFrame() const;
 		
 		static std::string getStateString(libvlc_state_t state);
+		static std::string getChromaString(Chroma chroma);
 	private:
 		std::shared_ptr<internal::StreamControllerPrivate> d_;
 	};
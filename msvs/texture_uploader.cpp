@@ -0,0 +1,244 @@
+//
+//	texture_uploader.cpp is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#include "texture_uploader.h"
+
+#include <string.h>
+#include <algorithm>
+
+TextureUploader::TextureUploader(unsigned nBuffers):
+isAsync_(true), isModeDetected_(false),
+mode_(Synchronous), bestMode_(Synchronous),
+nBuffers_(nBuffers ? nBuffers : 1), nextBuffer_(0), bufferSize_(0)
+{
+}
+
+TextureUploader::~TextureUploader()
+{
+	// GL objects can be deleted only if there is a context to delete them from
+	if (gl::hasCurrentContext())
+		release();
+}
+
+void TextureUploader::swap(TextureUploader& other)
+{
+	std::swap(isAsync_, other.isAsync_);
+	std::swap(isModeDetected_, other.isModeDetected_);
+	std::swap(mode_, other.mode_);
+	std::swap(bestMode_, other.bestMode_);
+	std::swap(nBuffers_, other.nBuffers_);
+	std::swap(nextBuffer_, other.nextBuffer_);
+	std::swap(bufferSize_, other.bufferSize_);
+	buffers_.swap(other.buffers_);
+}
+
+void TextureUploader::setAsync(bool isAsync)
+{
+	if (isAsync_ != isAsync)
+	{
+		isAsync_ = isAsync;
+		mode_ = (isAsync_ ? bestMode_ : Synchronous);
+		release();
+	}
+}
+
+void TextureUploader::upload(GLuint texture, unsigned width, unsigned height, const void* data)
+{
+	upload(texture, width, height, GL_RGBA, 4, width * 4, data);
+}
+
+void TextureUploader::upload(GLuint texture, unsigned width, unsigned height,
+	GLenum format, unsigned bytesPerPixel, unsigned pitch, const void* data)
+{
+	if (!isModeDetected_)
+		detectMode();
+
+	GLint rowLength = 0, alignment = 4;
+	bool isPadded = (pitch != width * bytesPerPixel);
+
+	// planes may be wider than picture and rows aren't necessarily 4-aligned
+	if (isPadded)
+	{
+		glGetIntegerv(GL_UNPACK_ROW_LENGTH, &rowLength);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, pitch / bytesPerPixel);
+	}
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	if (mode_ == Synchronous ||
+		!uploadAsync(texture, width, height, format, pitch * height, data))
+	{
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, data);
+	}
+
+	if (isPadded)
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+}
+
+void TextureUploader::release()
+{
+	for (auto& b : buffers_)
+	{
+		if (b.fence_)
+			gl::DeleteSync(b.fence_);
+
+		if (b.mapped_)
+		{
+			gl::BindBuffer(GL_PIXEL_UNPACK_BUFFER, b.pbo_);
+			gl::UnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+
+		gl::DeleteBuffers(1, &b.pbo_);
+	}
+
+	if (buffers_.size())
+		gl::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	buffers_.clear();
+	bufferSize_ = 0;
+	nextBuffer_ = 0;
+}
+
+std::string TextureUploader::getModeString(Mode mode)
+{
+	switch (mode)
+	{
+	case Synchronous:
+		return "Synchronous";
+	case Streaming:
+		return "Streaming";
+	case Persistent:
+		return "Persistent";
+	default:
+		break;
+	}
+
+	return "N/A";
+}
+
+//******************************************************************************
+void TextureUploader::detectMode()
+{
+	gl::loadExtensions();
+
+	if (gl::hasPersistentBuffers())
+		bestMode_ = Persistent;
+	else if (gl::hasPixelBuffers())
+		bestMode_ = Streaming;
+	else
+		bestMode_ = Synchronous;
+
+	mode_ = (isAsync_ ? bestMode_ : Synchronous);
+	isModeDetected_ = true;
+}
+
+void TextureUploader::allocateBuffers(size_t size)
+{
+	release();
+	buffers_.resize(nBuffers_);
+
+	for (auto& b : buffers_)
+	{
+		b.mapped_ = nullptr;
+		b.fence_ = nullptr;
+
+		gl::GenBuffers(1, &b.pbo_);
+		gl::BindBuffer(GL_PIXEL_UNPACK_BUFFER, b.pbo_);
+
+		if (mode_ == Persistent)
+		{
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+			gl::BufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+			b.mapped_ = gl::MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+		}
+		else
+			gl::BufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+	}
+
+	gl::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	bufferSize_ = size;
+
+	// persistent mapping may be refused by the driver - stream instead
+	if (mode_ == Persistent && !buffers_[0].mapped_)
+	{
+		bestMode_ = mode_ = Streaming;
+		allocateBuffers(size);
+	}
+}
+
+bool TextureUploader::uploadAsync(GLuint texture, unsigned width, unsigned height,
+	GLenum format, size_t frameSize, const void* data)
+{
+
+	if (frameSize != bufferSize_)
+		allocateBuffers(frameSize);
+
+	PixelBuffer& b = buffers_[nextBuffer_];
+
+	if (mode_ == Persistent)
+	{
+		// buffer is still being transferred - don't wait for it, upload directly
+		if (b.fence_)
+		{
+			GLenum res = gl::ClientWaitSync(b.fence_, 0, 0);
+
+			if (res == GL_TIMEOUT_EXPIRED || res == GL_WAIT_FAILED)
+				return false;
+
+			gl::DeleteSync(b.fence_);
+			b.fence_ = nullptr;
+		}
+
+		memcpy(b.mapped_, data, frameSize);
+		gl::BindBuffer(GL_PIXEL_UNPACK_BUFFER, b.pbo_);
+	}
+	else
+	{
+		gl::BindBuffer(GL_PIXEL_UNPACK_BUFFER, b.pbo_);
+		// orphan previous storage so mapping doesn't wait for pending transfer
+		gl::BufferData(GL_PIXEL_UNPACK_BUFFER, frameSize, NULL, GL_STREAM_DRAW);
+		void* ptr = gl::MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, frameSize,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+
+		if (!ptr)
+		{
+			gl::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			return false;
+		}
+
+		memcpy(ptr, data, frameSize);
+		gl::UnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, texture);
+	// with PBO bound, data pointer is an offset into the buffer
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, (const void*)0);
+	gl::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (mode_ == Persistent)
+		b.fence_ = gl::FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	nextBuffer_ = (nextBuffer_ + 1) % nBuffers_;
+
+	return true;
+}
@@ -0,0 +1,85 @@
+//
+//	texture_uploader.h is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#ifndef __texture_uploader_h__
+#define __texture_uploader_h__
+
+#include <string>
+#include <vector>
+
+#include "gl_helpers.h"
+
+/*
+Uploads video frames into textures. When pixel buffer objects are available,
+frame is written into one of the rotating PBOs (persistently mapped ones,
+if driver supports it) and texture is updated from the PBO, so the transfer
+happens asynchronously and doesn't stall the cook thread. Falls back to plain
+glTexSubImage2D from client memory otherwise.
+All calls must be made from the thread which owns the GL context.
+*/
+class TextureUploader {
+public:
+	typedef enum _Mode {
+		Synchronous,
+		Streaming,		// orphaned PBO, mapped for each frame
+		Persistent		// persistently mapped PBOs, guarded by fences
+	} Mode;
+
+	static const unsigned DefaultBuffers = 3;
+
+	TextureUploader(unsigned nBuffers = DefaultBuffers);
+	~TextureUploader();
+
+	void setAsync(bool isAsync);
+	void upload(GLuint texture, unsigned width, unsigned height, const void* data);
+	/**
+	 * Uploads single image plane. Pitch is the length of plane's row in 
+	 * bytes and can be larger than width*bytesPerPixel.
+	 */
+	void upload(GLuint texture, unsigned width, unsigned height,
+		GLenum format, unsigned bytesPerPixel, unsigned pitch, const void* data);
+	void release();
+	// exchanges GL objects and state with other uploader
+	void swap(TextureUploader& other);
+
+	Mode getMode() const { return mode_; }
+
+	static std::string getModeString(Mode mode);
+
+private:
+	struct PixelBuffer {
+		GLuint pbo_;
+		void* mapped_;
+		GLsync fence_;
+	};
+
+	bool isAsync_, isModeDetected_;
+	Mode mode_, bestMode_;
+	unsigned nBuffers_, nextBuffer_;
+	size_t bufferSize_;
+	std::vector<PixelBuffer> buffers_;
+
+	void detectMode();
+	void allocateBuffers(size_t size);
+	bool uploadAsync(GLuint texture, unsigned width, unsigned height,
+		GLenum format, size_t frameSize, const void* data);
+};
+
+#endif
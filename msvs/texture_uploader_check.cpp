@@ -0,0 +1,191 @@
+//
+//	texture_uploader_check.cpp is part of YouTubeTOP
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+// Headless check of TextureUploader. Creates a surfaceless EGL context (e.g.
+// Mesa llvmpipe), uploads a sequence of frames in Persistent, Streaming and
+// Synchronous modes, tightly packed and with padded rows, and compares
+// every texture read back with glGetTexImage against its source. Exits with
+// non-zero code if any mode is unavailable or any frame differs.
+//
+// Linux only, needs Mesa's GL and EGL headers:
+//	g++ -std=c++11 texture_uploader_check.cpp texture_uploader.cpp
+//		gl_helpers.cpp -lEGL -lGL -o texture_uploader_check
+//	EGL_PLATFORM=surfaceless LIBGL_ALWAYS_SOFTWARE=1 ./texture_uploader_check
+
+#include "texture_uploader.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace {
+	const unsigned Width = 333, Height = 187;
+	// more than uploader's buffers, so that each of them is reused
+	const unsigned NFrames = 2 * TextureUploader::DefaultBuffers + 1;
+
+	bool createContext()
+	{
+		EGLDisplay display = EGL_NO_DISPLAY;
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+		if (getPlatformDisplay)
+			display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (display == EGL_NO_DISPLAY)
+			display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+		EGLint major = 0, minor = 0;
+
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor) ||
+			!eglBindAPI(EGL_OPENGL_API))
+		{
+			printf("couldn't initialize EGL\n");
+			return false;
+		}
+
+		// surfaceless platform may offer no configs at all - none is needed
+		static const EGLint configAttribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+		EGLConfig config = (EGLConfig)0;
+		EGLint nConfigs = 0;
+
+		if (!eglChooseConfig(display, configAttribs, &config, 1, &nConfigs) || nConfigs == 0)
+			config = (EGLConfig)0;
+
+		// compatibility profile - TouchDesigner's context is one too
+		EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+
+		if (context == EGL_NO_CONTEXT ||
+			!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+		{
+			printf("couldn't make surfaceless context current\n");
+			return false;
+		}
+
+		printf("%s, GL %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+		return true;
+	}
+
+	void fillFrame(std::vector<unsigned char>& frame, unsigned pitch, unsigned frameNo)
+	{
+		for (unsigned y = 0; y < Height; ++y)
+			for (unsigned x = 0; x < pitch; ++x)
+				frame[y * pitch + x] = (unsigned char)(x * 7 + y * 13 + frameNo * 31);
+	}
+
+	bool checkMode(TextureUploader::Mode expected, bool isAsync, unsigned pitch)
+	{
+		GLuint texture;
+
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, Width, Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+		TextureUploader uploader;
+		std::vector<unsigned char> frame(pitch * Height), readback(Width * 4 * Height);
+		bool result = true;
+
+		uploader.setAsync(isAsync);
+
+		for (unsigned i = 0; i < NFrames && result; ++i)
+		{
+			fillFrame(frame, pitch, i);
+			uploader.upload(texture, Width, Height, GL_RGBA, 4, pitch, frame.data());
+
+			if (uploader.getMode() != expected)
+			{
+				printf("%s: uploader is in %s mode\n", TextureUploader::getModeString(expected).c_str(),
+					TextureUploader::getModeString(uploader.getMode()).c_str());
+				result = false;
+				break;
+			}
+
+			glBindTexture(GL_TEXTURE_2D, texture);
+			glPixelStorei(GL_PACK_ALIGNMENT, 1);
+			glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, readback.data());
+
+			for (unsigned y = 0; y < Height && result; ++y)
+			{
+				if (memcmp(&readback[y * Width * 4], &frame[y * pitch], Width * 4) != 0)
+				{
+					printf("%s: frame %u differs at row %u (pitch %u)\n",
+						TextureUploader::getModeString(expected).c_str(), i, y, pitch);
+					result = false;
+				}
+			}
+		}
+
+		uploader.release();
+		glDeleteTextures(1, &texture);
+
+		GLenum error = glGetError();
+
+		if (error != GL_NO_ERROR)
+		{
+			printf("%s: GL error 0x%x\n", TextureUploader::getModeString(expected).c_str(), error);
+			result = false;
+		}
+
+		if (result)
+			printf("%s: %u frames match (pitch %u)\n", TextureUploader::getModeString(expected).c_str(),
+				NFrames, pitch);
+
+		return result;
+	}
+
+	bool checkAllModes(unsigned pitch)
+	{
+		bool result = true;
+
+		if (!gl::hasPersistentBuffers())
+		{
+			printf("persistent buffers are not supported\n");
+			result = false;
+		}
+		else
+			result = checkMode(TextureUploader::Persistent, true, pitch) && result;
+
+		// without buffer storage uploader streams through orphaned buffers
+		gl::PFNBufferStorage bufferStorage = gl::BufferStorage;
+		gl::BufferStorage = nullptr;
+		result = checkMode(TextureUploader::Streaming, true, pitch) && result;
+		gl::BufferStorage = bufferStorage;
+
+		result = checkMode(TextureUploader::Synchronous, false, pitch) && result;
+
+		return result;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (!createContext())
+		return 2;
+
+	gl::loadExtensions();
+
+	bool result = checkAllModes(Width * 4);
+	// planes of decoded frames have rows padded for SIMD
+	result = checkAllModes(((Width + 31) & ~31) * 4) && result;
+
+	return (result ? 0 : 1);
+}
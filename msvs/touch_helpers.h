@@ -21,31 +21,72 @@
 #ifndef __touch_helpers_h__
 #define __touch_helpers_h__
 
-#include <map>
+#include <string>
+#include <vector>
 #include <string.h>
 #include <algorithm>
 
+/*
+One entry of compile-time parameter wiring: input T2 is read from 
+parameter page's array entry named name_ (e.g. "value3") at index_, and
+from its subIndex_-th value for float parameters. Wiring tables list 
+entries in the order of T2's values, so that an input is found by index.
+*/
+template<typename T2>
 struct TouchInput {
-	std::string name_;
+	T2 input_;
+	const char* name_;
 	unsigned int index_, subIndex_;
 };
 
+// true if i-th entry of wiring wires i-th input - check with static_assert
+template<typename T2, size_t N>
+constexpr bool isWiringOrdered(const TouchInput<T2> (&wiring)[N], size_t i = 0)
+{
+	return (i == N || ((size_t)wiring[i].input_ == i && isWiringOrdered(wiring, i + 1)));
+}
+
+/*
+Reads TouchDesigner's parameters by wiring. Names are validated against 
+input arrays only when their layout changes; after that values are read 
+by fixed index. Helper is kept by the node between cooks. Nothing here 
+allocates after construction: string values are written into caller's 
+strings, which keep their capacity between cooks.
+*/
 template<class T1, typename T2>
 class TouchInputHelper {
 public:
-	TouchInputHelper(std::map<T2, TouchInput> inputWiring):
-		inputWiring_(inputWiring){}
+	template<size_t N>
+	TouchInputHelper(const TouchInput<T2> (&inputWiring)[N]):
+		inputWiring_(inputWiring), nInputs_(N), kinds_(N, Unwired),
+		nFloatInputs_(-1), nStringInputs_(-1), 
+		floatInputs_(nullptr), stringInputs_(nullptr){}
 
 	bool getStringValue(const T1* arrays, T2 inputName,
 		std::string &value)
 	{
-		if (arrays->numStringInputs > inputWiring_[inputName].index_ &&
-			std::string(arrays->stringInputs[inputWiring_[inputName].index_].name) == inputWiring_[inputName].name_)
+		const TouchInput<T2>* input = getInput(arrays, inputName, String);
+
+		if (input)
 		{
-			std::string str = std::string(arrays->stringInputs[inputWiring_[inputName].index_].value);
-			str.erase(std::remove(str.begin(), str.end(), '\r'), str.end());
-			str.erase(std::remove(str.begin(), str.end(), '\n'), str.end());
-			value = str;
+			value.assign(arrays->stringInputs[input->index_].value);
+			value.erase(std::remove_if(value.begin(), value.end(), 
+				[](char c){ return c == '\r' || c == '\n'; }), value.end());
+			return true;
+		}
+		return false;
+	}
+
+	// keeps line breaks, e.g. for lists pasted from a DAT
+	bool getRawStringValue(const T1* arrays, T2 inputName,
+		std::string &value)
+	{
+		const TouchInput<T2>* input = getInput(arrays, inputName, String);
+
+		if (input)
+		{
+			value.assign(arrays->stringInputs[input->index_].value);
+			value.erase(std::remove(value.begin(), value.end(), '\r'), value.end());
 			return true;
 		}
 		return false;
@@ -54,12 +95,11 @@ public:
 	bool getFloatValue(const T1* arrays, T2 inputName,
 		float &value)
 	{
-		if (arrays->numFloatInputs > inputWiring_[inputName].index_ &&
-			std::string(arrays->floatInputs[inputWiring_[inputName].index_].name) == inputWiring_[inputName].name_)
+		const TouchInput<T2>* input = getInput(arrays, inputName, Float);
+
+		if (input)
 		{
-			int idx = inputWiring_[inputName].index_;
-			int subIdx = inputWiring_[inputName].subIndex_;
-			value = arrays->floatInputs[idx].values[subIdx];
+			value = arrays->floatInputs[input->index_].values[input->subIndex_];
 			return true;
 		}
 		return false;
@@ -87,19 +127,62 @@ public:
 	bool getBoolValue(const T1* arrays, T2 inputName,
 		bool &value)
 	{
-		if (arrays->numFloatInputs > inputWiring_[inputName].index_ &&
-			std::string(arrays->floatInputs[inputWiring_[inputName].index_].name) == inputWiring_[inputName].name_)
+		float floatValue = 0;
+
+		if (getFloatValue(arrays, inputName, floatValue))
 		{
-			int idx = inputWiring_[inputName].index_;
-			int subIdx = inputWiring_[inputName].subIndex_;
-			value = arrays->floatInputs[idx].values[subIdx] > 0.5;
+			value = floatValue > 0.5;
 			return true;
 		}
 		return false;
 	}
 
 private:
-	std::map<T2, TouchInput> inputWiring_;
+	typedef enum _Kind {
+		Unwired,	// no array entry with wired name at wired index
+		Float,
+		String
+	} Kind;
+
+	const TouchInput<T2>* inputWiring_;
+	size_t nInputs_;
+	std::vector<Kind> kinds_;
+	// layout of arrays kinds_ were validated against
+	int nFloatInputs_, nStringInputs_;
+	const void *floatInputs_, *stringInputs_;
+
+	const TouchInput<T2>* getInput(const T1* arrays, T2 inputName, Kind kind)
+	{
+		if (arrays->numFloatInputs != nFloatInputs_ || arrays->floatInputs != floatInputs_ ||
+			arrays->numStringInputs != nStringInputs_ || arrays->stringInputs != stringInputs_)
+			validate(arrays);
+
+		size_t idx = (size_t)inputName;
+
+		return (idx < nInputs_ && kinds_[idx] == kind ? &inputWiring_[idx] : nullptr);
+	}
+
+	void validate(const T1* arrays)
+	{
+		for (size_t i = 0; i < nInputs_; ++i)
+		{
+			const TouchInput<T2>& input = inputWiring_[i];
+
+			if ((int)input.index_ < arrays->numStringInputs &&
+				strcmp(arrays->stringInputs[input.index_].name, input.name_) == 0)
+				kinds_[i] = String;
+			else if ((int)input.index_ < arrays->numFloatInputs &&
+				strcmp(arrays->floatInputs[input.index_].name, input.name_) == 0)
+				kinds_[i] = Float;
+			else
+				kinds_[i] = Unwired;
+		}
+
+		nFloatInputs_ = arrays->numFloatInputs;
+		nStringInputs_ = arrays->numStringInputs;
+		floatInputs_ = arrays->floatInputs;
+		stringInputs_ = arrays->stringInputs;
+	}
 };
 
 #endif
\ No newline at end of file
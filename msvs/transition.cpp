@@ -0,0 +1,103 @@
+//
+//	transition.cpp is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#include "transition.h"
+
+Transition::Transition():
+isActive_(false), type_(Cut), durationMs_(0)
+{
+}
+
+void Transition::start(Type type, int64_t durationMs)
+{
+	isActive_ = (type != Cut && durationMs > 0);
+	type_ = type;
+	durationMs_ = durationMs;
+	startTime_ = std::chrono::steady_clock::now();
+}
+
+void Transition::stop()
+{
+	isActive_ = false;
+}
+
+bool Transition::isFinished() const
+{
+	return (getProgress() >= 1.);
+}
+
+double Transition::getProgress() const
+{
+	if (!isActive_ || durationMs_ <= 0)
+		return 1.;
+
+	double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime_).count();
+
+	return (elapsedMs >= durationMs_ ? 1. : elapsedMs / durationMs_);
+}
+
+void Transition::draw(VideoTexture& from, VideoTexture& to, unsigned width, unsigned height)
+{
+	float progress = (float)getProgress();
+
+	// whatever isn't covered by textures is black
+	glClearColor(0., 0., 0., 1.);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	switch (type_)
+	{
+	case Crossfade:
+		from.draw(width, height);
+		to.draw(width, height, progress);
+		break;
+	case Dip:
+		if (progress < .5f)
+			from.draw(width, height, 1.f - 2.f * progress);
+		else
+			to.draw(width, height, 2.f * progress - 1.f);
+		break;
+	case Wipe:
+		from.draw(width, height);
+		to.draw(width, height, 1.f, 0.f, progress);
+		break;
+	default:
+		to.draw(width, height);
+		break;
+	}
+}
+
+std::string Transition::getTypeString(Type type)
+{
+	switch (type)
+	{
+	case Cut:
+		return "Cut";
+	case Crossfade:
+		return "Crossfade";
+	case Dip:
+		return "Dip";
+	case Wipe:
+		return "Wipe";
+	default:
+		break;
+	}
+
+	return "N/A";
+}
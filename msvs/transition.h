@@ -0,0 +1,73 @@
+//
+//	transition.h is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#ifndef __transition_h__
+#define __transition_h__
+
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+#include "video_texture.h"
+
+/*
+Blends outgoing stream into incoming one when TOP switches streams. Both
+textures are drawn on GPU, pixels never go through CPU. Progress is
+measured in wall time, so a blend takes as long as it was asked to
+whatever the cook rate is.
+Must be used from the thread which owns the GL context.
+*/
+class Transition {
+public:
+	typedef enum _Type {
+		Cut,
+		Crossfade,
+		Dip,		// fades to black and back up
+		Wipe		// incoming one is revealed from left to right
+	} Type;
+
+	Transition();
+
+	void start(Type type, int64_t durationMs);
+	void stop();
+
+	bool isActive() const { return isActive_; }
+	// true once transition has run for its duration
+	bool isFinished() const;
+	// 0..1 part of duration passed
+	double getProgress() const;
+	Type getType() const { return type_; }
+
+	/**
+	 * Draws current blend of two textures, both stretched to width x 
+	 * height.
+	 */
+	void draw(VideoTexture& from, VideoTexture& to, unsigned width, unsigned height);
+
+	static std::string getTypeString(Type type);
+
+private:
+	bool isActive_;
+	Type type_;
+	int64_t durationMs_;
+	std::chrono::steady_clock::time_point startTime_;
+};
+
+#endif
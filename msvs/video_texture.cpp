@@ -0,0 +1,289 @@
+//
+//	video_texture.cpp is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#include "video_texture.h"
+
+#include <string>
+#include <algorithm>
+
+using namespace vlc;
+
+// video range YUV -> RGB. BT.709 is used for HD content, BT.601 otherwise
+static const char* YuvFragmentShader =
+"#version 110\n"
+"uniform sampler2D planeY;\n"
+"uniform sampler2D planeU;\n"
+"uniform sampler2D planeV;\n"
+"uniform float bt709;\n"
+"uniform float opacity;\n"
+"void main()\n"
+"{\n"
+"	vec2 tc = gl_TexCoord[0].st;\n"
+"	float y = 1.1643 * (texture2D(planeY, tc).r - 0.0625);\n"
+"#ifdef NV12\n"
+"	vec2 uv = texture2D(planeU, tc).ra - 0.5;\n"
+"#else\n"
+"	vec2 uv = vec2(texture2D(planeU, tc).r, texture2D(planeV, tc).r) - 0.5;\n"
+"#endif\n"
+"	vec3 bt601rgb = vec3(y + 1.5958 * uv.y, y - 0.3917 * uv.x - 0.8129 * uv.y, y + 2.0172 * uv.x);\n"
+"	vec3 bt709rgb = vec3(y + 1.7927 * uv.y, y - 0.2132 * uv.x - 0.5329 * uv.y, y + 2.1124 * uv.x);\n"
+"	gl_FragColor = vec4(clamp(mix(bt601rgb, bt709rgb, bt709), 0.0, 1.0), opacity);\n"
+"}\n";
+
+VideoTexture::VideoTexture():
+chroma_(StreamController::RGBA), width_(0), height_(0), nPlanes_(0),
+program_(0)
+{
+	for (unsigned i = 0; i < StreamController::MaxPlanes; ++i)
+		textures_[i] = 0;
+}
+
+VideoTexture::~VideoTexture()
+{
+	// GL objects can be deleted only if there is a context to delete them from
+	if (gl::hasCurrentContext())
+		release();
+}
+
+bool VideoTexture::isChromaSupported(StreamController::Chroma chroma)
+{
+	if (chroma == StreamController::RGBA)
+		return true;
+
+	gl::loadExtensions();
+
+	return gl::hasShaders();
+}
+
+void VideoTexture::init(StreamController::Chroma chroma, unsigned width, unsigned height)
+{
+	release();
+
+	chroma_ = chroma;
+	width_ = width;
+	height_ = height;
+
+	switch (chroma_)
+	{
+	case StreamController::I420:
+		nPlanes_ = 3;
+		break;
+	case StreamController::NV12:
+		nPlanes_ = 2;
+		break;
+	default:
+		nPlanes_ = 1;
+		break;
+	}
+
+	if (chroma_ != StreamController::RGBA && !(program_ = createProgram()))
+	{
+		nPlanes_ = 0;
+		return;
+	}
+
+	glGenTextures(nPlanes_, textures_);
+
+	for (unsigned i = 0; i < nPlanes_; ++i)
+	{
+		unsigned planeWidth, planeHeight, bytesPerPixel;
+		GLenum format;
+
+		getPlaneFormat(i, planeWidth, planeHeight, format, bytesPerPixel);
+
+		glBindTexture(GL_TEXTURE_2D, textures_[i]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		// chroma planes are sampled between texels - don't let edges wrap around
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexImage2D(GL_TEXTURE_2D, 0, format, planeWidth, planeHeight, 0, format, GL_UNSIGNED_BYTE, NULL);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void VideoTexture::release()
+{
+	if (nPlanes_)
+		glDeleteTextures(nPlanes_, textures_);
+
+	if (program_)
+		gl::DeleteProgram(program_);
+
+	for (unsigned i = 0; i < StreamController::MaxPlanes; ++i)
+	{
+		textures_[i] = 0;
+		uploaders_[i].release();
+	}
+
+	program_ = 0;
+	nPlanes_ = 0;
+}
+
+void VideoTexture::swap(VideoTexture& other)
+{
+	std::swap(chroma_, other.chroma_);
+	std::swap(width_, other.width_);
+	std::swap(height_, other.height_);
+	std::swap(nPlanes_, other.nPlanes_);
+	std::swap(program_, other.program_);
+
+	for (unsigned i = 0; i < StreamController::MaxPlanes; ++i)
+	{
+		std::swap(textures_[i], other.textures_[i]);
+		uploaders_[i].swap(other.uploaders_[i]);
+	}
+}
+
+void VideoTexture::upload(const StreamController::FrameRef& frame)
+{
+	if (!nPlanes_ || !frame ||
+		frame.chroma() != chroma_ ||
+		frame.width() != width_ || frame.height() != height_)
+		return;
+
+	const unsigned char* planes[StreamController::MaxPlanes];
+	unsigned pitches[StreamController::MaxPlanes];
+
+	for (unsigned i = 0; i < nPlanes_; ++i)
+	{
+		planes[i] = frame.plane(i);
+		pitches[i] = frame.pitch(i);
+	}
+
+	upload(planes, pitches);
+}
+
+void VideoTexture::upload(const unsigned char* const* planes, const unsigned* pitches)
+{
+	for (unsigned i = 0; i < nPlanes_; ++i)
+	{
+		unsigned planeWidth, planeHeight, bytesPerPixel;
+		GLenum format;
+
+		getPlaneFormat(i, planeWidth, planeHeight, format, bytesPerPixel);
+		uploaders_[i].upload(textures_[i], planeWidth, planeHeight, format,
+			bytesPerPixel, pitches[i], planes[i]);
+	}
+}
+
+void VideoTexture::draw(unsigned width, unsigned height)
+{
+	draw(width, height, 1.f);
+}
+
+void VideoTexture::draw(unsigned width, unsigned height, float opacity, float left, float right)
+{
+	if (!nPlanes_)
+		return;
+
+	bool isBlended = (opacity < 1.f);
+
+	if (isBlended)
+	{
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	}
+
+	if (program_)
+	{
+		gl::UseProgram(program_);
+		gl::Uniform1i(gl::GetUniformLocation(program_, "planeY"), 0);
+		gl::Uniform1i(gl::GetUniformLocation(program_, "planeU"), 1);
+		gl::Uniform1i(gl::GetUniformLocation(program_, "planeV"), 2);
+		gl::Uniform1f(gl::GetUniformLocation(program_, "bt709"), (height_ >= 720 ? 1.f : 0.f));
+		gl::Uniform1f(gl::GetUniformLocation(program_, "opacity"), opacity);
+
+		for (unsigned i = nPlanes_; i-- > 0;)
+		{
+			gl::ActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(GL_TEXTURE_2D, textures_[i]);
+		}
+	}
+	else
+	{
+		glEnable(GL_TEXTURE_2D);
+		glBindTexture(GL_TEXTURE_2D, textures_[0]);
+		// texture is modulated by vertex color, alpha included
+		glColor4f(1.f, 1.f, 1.f, opacity);
+	}
+
+	glLoadIdentity();
+
+	glBegin(GL_QUADS);
+	// the reason why texture coordinates are weird - the texture is flipped horizontally
+	glTexCoord2f(left, 1.); glVertex2f(left * width, 0.f);
+	glTexCoord2f(right, 1.); glVertex2f(right * width, 0.f);
+	glTexCoord2f(right, 0.); glVertex2f(right * width, (float)height);
+	glTexCoord2f(left, 0.); glVertex2f(left * width, (float)height);
+	glEnd();
+
+	if (program_)
+		gl::UseProgram(0);
+	else
+		glColor4f(1.f, 1.f, 1.f, 1.f);
+
+	if (isBlended)
+		glDisable(GL_BLEND);
+}
+
+void VideoTexture::setAsync(bool isAsync)
+{
+	for (auto& u : uploaders_)
+		u.setAsync(isAsync);
+}
+
+//******************************************************************************
+void VideoTexture::getPlaneFormat(unsigned plane, unsigned& width, unsigned& height,
+	GLenum& format, unsigned& bytesPerPixel) const
+{
+	bool isChromaPlane = (chroma_ != StreamController::RGBA && plane > 0);
+
+	width = (isChromaPlane ? (width_ + 1) / 2 : width_);
+	height = (isChromaPlane ? (height_ + 1) / 2 : height_);
+
+	if (chroma_ == StreamController::RGBA)
+	{
+		format = GL_RGBA;
+		bytesPerPixel = 4;
+	}
+	else if (chroma_ == StreamController::NV12 && isChromaPlane)
+	{
+		format = GL_LUMINANCE_ALPHA;
+		bytesPerPixel = 2;
+	}
+	else
+	{
+		format = GL_LUMINANCE;
+		bytesPerPixel = 1;
+	}
+}
+
+GLuint VideoTexture::createProgram()
+{
+	std::string source(YuvFragmentShader), errorLog;
+
+	// defines must follow #version directive
+	if (chroma_ == StreamController::NV12)
+		source.insert(source.find('\n') + 1, "#define NV12\n");
+
+	return gl::compileProgram(source.c_str(), errorLog);
+}
@@ -0,0 +1,94 @@
+//
+//	video_texture.h is part of YouTubeTOP.dll
+//
+//	Copyright 2016 Regents of the University of California
+//
+//	This program is free software : you can redistribute it and / or modify
+//	it under the terms of the GNU Lesser General Public License as published by
+//	the Free Software Foundation, either version 3 of the License, or
+//	(at your option) any later version.
+//
+//	This program is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+//	GNU Lesser General Public License for more details.
+//
+//	You should have received a copy of the GNU Lesser General Public License
+//	along with this program.If not, see <http://www.gnu.org/licenses/>.
+//
+//	Author: Peter Gusev, peter@remap.ucla.edu
+
+#ifndef __video_texture_h__
+#define __video_texture_h__
+
+#include "gl_helpers.h"
+#include "texture_uploader.h"
+#include "stream_controller.h"
+
+/*
+Holds textures for one video stream. RGBA frames go into a single texture,
+planar frames (I420, NV12) are uploaded plane by plane as is and converted
+to RGB by a fragment shader while drawing, so neither VLC nor the cook
+thread spends time on colorspace conversion and a quarter to a half less
+data crosses the bus.
+All calls must be made from the thread which owns the GL context.
+*/
+class VideoTexture {
+public:
+	VideoTexture();
+	~VideoTexture();
+
+	/**
+	 * Returns true if frames of given chroma can be drawn by this class
+	 * with the current GL context.
+	 */
+	static bool isChromaSupported(vlc::StreamController::Chroma chroma);
+
+	/**
+	 * (Re)creates plane textures for given format.
+	 */
+	void init(vlc::StreamController::Chroma chroma, unsigned width, unsigned height);
+	void release();
+
+	/**
+	 * Exchanges textures with other instance, e.g. to show a frame that
+	 * was staged in a spare texture without uploading it again.
+	 */
+	void swap(VideoTexture& other);
+
+	/**
+	 * Uploads frame into textures. Frames which don't match texture
+	 * format are ignored.
+	 */
+	void upload(const vlc::StreamController::FrameRef& frame);
+	// uploads planes laid out the same way as frames of texture's format
+	void upload(const unsigned char* const* planes, const unsigned* pitches);
+	void draw(unsigned width, unsigned height);
+	/**
+	 * Draws horizontal slice of the frame between left and right (0..1 of
+	 * width) over framebuffer contents, blended with given opacity.
+	 */
+	void draw(unsigned width, unsigned height, float opacity, 
+		float left = 0.f, float right = 1.f);
+
+	void setAsync(bool isAsync);
+	TextureUploader::Mode getUploadMode() const { return uploaders_[0].getMode(); }
+
+	bool isValid() const { return nPlanes_ > 0; }
+	vlc::StreamController::Chroma getChroma() const { return chroma_; }
+	unsigned getWidth() const { return width_; }
+	unsigned getHeight() const { return height_; }
+
+private:
+	vlc::StreamController::Chroma chroma_;
+	unsigned width_, height_, nPlanes_;
+	GLuint textures_[vlc::StreamController::MaxPlanes];
+	TextureUploader uploaders_[vlc::StreamController::MaxPlanes];
+	GLuint program_;
+
+	void getPlaneFormat(unsigned plane, unsigned& width, unsigned& height,
+		GLenum& format, unsigned& bytesPerPixel) const;
+	GLuint createProgram();
+};
+
+#endif
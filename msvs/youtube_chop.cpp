@@ -31,10 +31,59 @@
 #include "youtube_top.h"
 #include "shared_data.h"
 #include "stream_controller.h"
+#include "audio_kernels.h"
+#include "allocation_counter.h"
 
 using namespace std::placeholders;
 using namespace vlc;
 
+// VLC's audio output supports up to 9 channels
+static const unsigned MaxAudioChannels = 32;
+
+// frames may straddle blocks; such frame is gathered separately
+static void deinterleave(const audio::Subscription& subscription, size_t nSamples,
+	unsigned nChannels, float* const* channels, unsigned nOutChannels)
+{
+	float* dst[MaxAudioChannels];
+	float frame[MaxAudioChannels];
+	unsigned nGathered = 0;
+
+	for (unsigned j = 0; j < nOutChannels; ++j)
+		dst[j] = channels[j];
+
+	subscription.peek(nSamples, [&](const float* samples, size_t length) {
+		if (nGathered)
+		{
+			size_t head = nChannels - nGathered;
+
+			if (head > length)
+				head = length;
+
+			memcpy(frame + nGathered, samples, head*sizeof(frame[0]));
+			nGathered += (unsigned)head;
+			samples += head;
+			length -= head;
+
+			if (nGathered < nChannels)
+				return;
+
+			audio::deinterleave(frame, 1, nChannels, dst, nOutChannels);
+			for (unsigned j = 0; j < nOutChannels; ++j)
+				dst[j] += 1;
+			nGathered = 0;
+		}
+
+		size_t nFrames = length / nChannels;
+
+		audio::deinterleave(samples, nFrames, nChannels, dst, nOutChannels);
+		for (unsigned j = 0; j < nOutChannels; ++j)
+			dst[j] += nFrames;
+
+		nGathered = (unsigned)(length % nChannels);
+		memcpy(frame, samples + nFrames*nChannels, nGathered*sizeof(frame[0]));
+	});
+}
+
 enum class InfoDatIndex {
 	State,
 	Binding,
@@ -52,9 +101,12 @@ enum class InfoChopIndex {
 	Samples,
 	SampleRate,
 	nChannels,
-	WriteCycle,
-	ReadCycle,
-	Delay
+	Delay,
+	Overflows,
+	Underflows,
+	Ratio,
+	FillLevel,
+	Allocations
 };
 
 static std::map<InfoChopIndex, std::string> ChanNames = {
@@ -62,19 +114,36 @@ static std::map<InfoChopIndex, std::string> ChanNames = {
 	{ InfoChopIndex::Samples, "nSamples" },	
 	{ InfoChopIndex::SampleRate, "sampleRate" },
 	{ InfoChopIndex::nChannels, "nChannels" },
-	{ InfoChopIndex::WriteCycle, "writeCycle" },
-	{ InfoChopIndex::ReadCycle, "readCycle" },
-	{ InfoChopIndex::Delay, "delaySec" }
+	{ InfoChopIndex::Delay, "delaySec" },
+	{ InfoChopIndex::Overflows, "overflows" },
+	{ InfoChopIndex::Underflows, "underflows" },
+	{ InfoChopIndex::Ratio, "ratio" },
+	{ InfoChopIndex::FillLevel, "fillSec" },
+	{ InfoChopIndex::Allocations, "allocations" }
 };
 
-enum class TouchInputName {
-	TopPath
-};
+typedef YouTubeCHOP::TouchInputName TouchInputName;
 
-static std::map<TouchInputName, TouchInput> TouchInputs = {
-	{ TouchInputName::TopPath,{ "string0", 0, 0 } }
+// entries follow the order of TouchInputName
+static constexpr TouchInput<TouchInputName> TouchInputs[] = {
+	{ TouchInputName::TopPath, "string0", 0, 0 },
+	{ TouchInputName::OutputRate, "value0", 0, 0 },
+	{ TouchInputName::Latency, "value0", 0, 1 }
 };
 
+static_assert(isWiringOrdered(TouchInputs), "TouchInputs must follow the order of TouchInputName");
+
+// drift compensation controller gains; error is measured in seconds
+static const double RatioKp = 0.05;
+static const double RatioKi = 0.002;
+// max deviation of resampling ratio from nominal, 0.5% is ~9 cents
+static const double MaxRatioCorrection = 0.005;
+// smoothing of fill level and VLC's delay, VLC delivers audio in bursts
+static const double FillSmoothing = 0.02;
+// fill level error which is resolved by jump rather than resampling
+static const double MaxFillErrorSec = 0.5;
+static const double MaxLatencySec = 5;
+
 // These functions are basic C function, which the DLL loader can find
 // much easier than finding a C++ Class.
 // The DLLEXPORT prefix is needed so the compile exports these functions from the .dll
@@ -112,19 +181,20 @@ extern "C"
 };
 
 YouTubeCHOP::YouTubeCHOP(const CHOP_NodeInfo *info) : myNodeInfo(info),
-status_(NotBinded), top_(nullptr), audioBuffer_(nullptr),
-bufferSize_(0), bufferWriterPtr_(0), bufferReadPtr_(0)
+status_(NotBinded), inputHelper_(TouchInputs), top_(nullptr), bindingGeneration_(0), subscription_(std::make_shared<audio::Subscription>()),
+formatVersion_(0), isPrimed_(false), ratio_(1), delayAverage_(0), errorAverage_(0), errorIntegral_(0),
+cookAllocations_()
 {
 	myExecuteCount = 0;
+	parameters_.outputRate_ = 0;
+	parameters_.latencyMs_ = 0;
 }
 
 YouTubeCHOP::~YouTubeCHOP()
 {
-	top_ = loadTop(parameters_.topFullPath_);
-	if (top_) top_->registerAudioCallback(nullptr);
-
-	if (audioBuffer_)
-		free(audioBuffer_);
+	// TOP may have been deleted before us
+	if (top_ && SharedData::getTop(topKey_) == top_)
+		top_->unsubscribeAudio(subscription_);
 }
 
 void
@@ -134,6 +204,9 @@ YouTubeCHOP::getGeneralInfo(CHOP_GeneralInfo *ginfo)
 	ginfo->cookEveryFrameIfAsked = true;
 	ginfo->timeslice = true;
 	ginfo->inputMatchIndex = 0;
+
+	// steady once audio flows from a bound TOP
+	cookAllocations_.begin(top_ && isPrimed_);
 }
 
 bool
@@ -145,11 +218,12 @@ YouTubeCHOP::getOutputInfo(CHOP_OutputInfo *info)
 		info->sampleRate = 44100;
 	else
 	{
-		if (audioInfo_.channels_ != 0)
-		{
-			ScopedLock lock(bufferAccess_);
-			info->sampleRate = audioInfo_.rate_; // / audioInfo_.channels_;
-		}
+		float outputRate = 0;
+
+		inputHelper_.getFloatValue(info->inputArrays, TouchInputName::OutputRate, outputRate);
+
+		if (subscription_->getChannels() != 0)
+			info->sampleRate = (outputRate > 0 ? outputRate : subscription_->getRate());
 		else
 			info->sampleRate = 1;
 	}
@@ -167,36 +241,91 @@ void
 YouTubeCHOP::execute(const CHOP_Output* output,
 	const CHOP_InputArrays* inputs,
 	void* reserved)
+{
+	cook(output, inputs);
+	cookAllocations_.end(top_ && isPrimed_, myNodeInfo->nodeFullPath);
+}
+
+void
+YouTubeCHOP::cook(const CHOP_Output* output, const CHOP_InputArrays* inputs)
 {
 	updateParameters(inputs);
 	myExecuteCount++;
 
-	unsigned nSamplesPerChannel = output->length;
-	unsigned nSamples = audioInfo_.channels_*nSamplesPerChannel;	
+	for (int j = 0; j < output->numChannels; j++)
+		memset(output->channels[j], 0, output->length*sizeof(float));
 
-	for (int j = 0; j < audioInfo_.channels_; j++)
-		memset(output->channels[j], 0, nSamplesPerChannel*sizeof(float));
+	subscription_->poll();
 
-	if (bufferSize_ > 0 && top_ && top_->getIsPlaying())
+	if (subscription_->getFormatVersion() != formatVersion_)
 	{
-		if (bufferReadPtr_ >= 0)
-		{
-			if (bufferWriterPtr_ - bufferReadPtr_ >= nSamples*sizeof(StreamController::sample_type))
-			{
-				for (int i = 0; i < nSamplesPerChannel; i++)
-				{
-					for (int j = 0; j < audioInfo_.channels_; j++)
-					{
-						unsigned sampleIdx = (bufferReadPtr_%bufferSize_) / sizeof(StreamController::sample_type);
-						output->channels[j][i] = ((float)audioBuffer_[sampleIdx] / (float)StreamController::MaxSampleValue);
-						bufferReadPtr_ += sizeof(StreamController::sample_type);
-					}
-				}
-			}
-		}
-		else
-			bufferReadPtr_ += nSamples * sizeof(StreamController::sample_type);
+		formatVersion_ = subscription_->getFormatVersion();
+		isPrimed_ = false;
+	}
+
+	unsigned nChannels = subscription_->getChannels();
+
+	if (nChannels == 0 || nChannels > MaxAudioChannels || !top_ || !top_->getIsPlaying())
+	{
+		isPrimed_ = false;
+		return;
+	}
+
+	unsigned nOutChannels = (nChannels < (unsigned)output->numChannels ? nChannels : output->numChannels);
+	double inRate = subscription_->getRate(), outRate = output->sampleRate;
+	size_t nFrames = output->length;
+	// most input frames one block may take
+	size_t maxInput = (size_t)ceil(nFrames * inRate / outRate * (1 + MaxRatioCorrection)) + audio::Resampler::NTaps;
+	double delay = (double)subscription_->getDelayUsec() / 1000000;
+
+	delayAverage_ = (isPrimed_ ? delayAverage_ + FillSmoothing*(delay - delayAverage_) : delay);
+
+	// reader lags writer by VLC's playback delay, so that audio stays in
+	// sync with video, unless latency is set explicitly
+	double latency = (parameters_.latencyMs_ > 0 ? parameters_.latencyMs_ / 1000 : delayAverage_);
+	size_t target = (size_t)ceil(latency * inRate);
+	size_t maxTarget = (size_t)(MaxLatencySec * inRate);
+
+	target = (target < maxInput ? maxInput : (target > maxTarget ? maxTarget : target));
+
+	if (isPrimed_ &&
+		fabs((double)subscription_->available() / nChannels - (double)target) / inRate > MaxFillErrorSec)
+		isPrimed_ = false;
+
+	if (!isPrimed_)
+	{
+		// output silence until that much is buffered
+		if (subscription_->available() < (target + maxInput)*nChannels)
+			return;
+
+		subscription_->trim((target + maxInput)*nChannels);
+		resampler_.reset(nOutChannels, inRate, outRate);
+		ratio_ = resampler_.getNominalRatio();
+		errorAverage_ = 0;
+		errorIntegral_ = 0;
+		isPrimed_ = true;
 	}
+	else if (resampler_.getChannels() != nOutChannels ||
+		resampler_.getInputRate() != inRate || resampler_.getOutputRate() != outRate)
+	{
+		resampler_.reset(nOutChannels, inRate, outRate);
+		ratio_ = resampler_.getNominalRatio();
+	}
+
+	size_t nInput = resampler_.getInputNeeded(nFrames, ratio_);
+	if (subscription_->available() < nInput*nChannels)
+	{
+		// buffer up to target latency again rather than stutter
+		subscription_->countUnderflow();
+		isPrimed_ = false;
+		return;
+	}
+
+	deinterleave(*subscription_, nInput*nChannels, nChannels, resampler_.prepareInput(nInput), nOutChannels);
+	subscription_->consume(nInput*nChannels);
+	resampler_.process(output->channels, nFrames, ratio_);
+
+	updateRatio(subscription_->available() / nChannels, target, nFrames / outRate);
 }
 
 int
@@ -224,16 +353,29 @@ YouTubeCHOP::getInfoCHOPChan(int index,
 			chan->value = 0;
 			break;
 		case InfoChopIndex::SampleRate:
-			chan->value = audioInfo_.rate_;
+			chan->value = subscription_->getRate();
 			break;
 		case InfoChopIndex::nChannels:
-			chan->value = audioInfo_.channels_;
+			chan->value = subscription_->getChannels();
+			break;
+		case InfoChopIndex::Delay:
+			chan->value = (float)subscription_->getDelayUsec() / 1000000;
+			break;
+		case InfoChopIndex::Overflows:
+			chan->value = (float)subscription_->getOverflows();
 			break;
-		case InfoChopIndex::WriteCycle:
-			chan->value = (bufferSize_ > 0 ? (bufferWriterPtr_ % bufferSize_)/2 : 0);
+		case InfoChopIndex::Underflows:
+			chan->value = (float)subscription_->getUnderflows();
 			break;
-		case InfoChopIndex::ReadCycle:
-			chan->value = (bufferSize_ > 0 ? (bufferReadPtr_ % bufferSize_)/2 : 0);
+		case InfoChopIndex::Ratio:
+			chan->value = (float)ratio_;
+			break;
+		case InfoChopIndex::FillLevel:
+			chan->value = (subscription_->getChannels() && subscription_->getRate() ?
+				(float)subscription_->available() / subscription_->getChannels() / subscription_->getRate() : 0);
+			break;
+		case InfoChopIndex::Allocations:
+			chan->value = (AllocationCounter::isEnabled() ? (float)cookAllocations_.get() : -1.f);
 			break;
 		default:
 			break;
@@ -259,8 +401,7 @@ YouTubeCHOP::getInfoDATEntries(int index,
 {
 	static char tempBuffer1[4096];
 	static char tempBuffer2[4096];
-	memset(tempBuffer1, 0, 4096);
-	memset(tempBuffer2, 0, 4096);
+	tempBuffer1[0] = tempBuffer2[0] = '\0';
 
 	InfoDatIndex idx = (InfoDatIndex)index;
 
@@ -270,15 +411,15 @@ YouTubeCHOP::getInfoDATEntries(int index,
 		switch (idx)
 		{
 		case InfoDatIndex::State:
-			sprintf(tempBuffer2, "%s", getStatusString(status_).c_str());
+			snprintf(tempBuffer2, sizeof(tempBuffer2), "%s", getStatusString(status_).c_str());
 			break;
 		case InfoDatIndex::Binding:
-			sprintf(tempBuffer2, "%s", parameters_.topFullPath_.c_str());
+			snprintf(tempBuffer2, sizeof(tempBuffer2), "%s", parameters_.topFullPath_.c_str());
 			break;
 		case InfoDatIndex::Format:
 			if (top_)
 			{
-				sprintf(tempBuffer2, "%s", audioInfo_.format_);
+				snprintf(tempBuffer2, sizeof(tempBuffer2), "%s", (subscription_->getSourceFormat() == StreamController::FL32 ? "FL32" : "S16N"));
 			}
 			break;
 		default:
@@ -290,81 +431,61 @@ YouTubeCHOP::getInfoDATEntries(int index,
 	entries->values[1] = tempBuffer2;
 }
 
-void YouTubeCHOP::onAudioData(vlc::StreamController::AudioData ad)
+// PI controller: when ring fills up, input is consumed slightly faster
+void YouTubeCHOP::updateRatio(size_t fill, size_t target, double dt)
 {
-	audioInfo_ = ad.audioInfo_;
-	makeBuffer(ad.delayUsec_, ad.audioInfo_);
-	lastDelay_ = ad.delayUsec_;
-
-	unsigned writeOffset = bufferWriterPtr_%bufferSize_;
-	byte* writePtr = (reinterpret_cast<byte*>(audioBuffer_) + writeOffset);
-	byte* srcPtr = (reinterpret_cast<byte*>(ad.buffer_));
-	
-	// audio buffer is cyclic
-	if (writeOffset + ad.bufferSize_ > bufferSize_)
-	{
-		unsigned excess = (writeOffset + ad.bufferSize_ - bufferSize_);
-		unsigned part1 = ad.bufferSize_ - excess, part2 = excess;
-		memcpy(writePtr, srcPtr, part1);
+	double inRate = resampler_.getInputRate();
+	double error = ((double)fill - (double)target) / inRate;
 
-		writePtr = reinterpret_cast<byte*>(audioBuffer_);
-		memcpy(writePtr, srcPtr+part1, part2);
-	}
-	else
-		memcpy(writePtr, srcPtr, ad.bufferSize_);
-
-	bufferWriterPtr_ += ad.bufferSize_;
-}
+	errorAverage_ += FillSmoothing*(error - errorAverage_);
+	errorIntegral_ += errorAverage_*dt;
 
-void YouTubeCHOP::makeBuffer(const uint64_t& delay,
-	const StreamController::Status::AudioInfo& ai)
-{
-	unsigned int multiple = 2;
-	unsigned int bytesPerSec = ai.channels_ * ai.rate_;
-	int delayInBytes = (int)ceil((double)delay / 1000000 * bytesPerSec);
-	int lastDelayInBytes = (int)ceil((double)lastDelay_ / 1000000 * bytesPerSec);
-	unsigned int bufSizeBytes = multiple * delayInBytes;
+	double correction = RatioKp*errorAverage_ + RatioKi*errorIntegral_;
 
-	if (bufferSize_ < bufSizeBytes || !audioBuffer_)
+	if (fabs(correction) > MaxRatioCorrection)
 	{
-		ScopedLock lock(bufferAccess_);
-		bufferSize_ = bufSizeBytes;
-		audioBuffer_ = (StreamController::sample_type*)realloc(audioBuffer_, bufferSize_);
-		bufferWriterPtr_ = 0;
-		bufferReadPtr_ = -delayInBytes;
+		// don't wind up integral while saturated
+		errorIntegral_ -= errorAverage_*dt;
+		correction = (correction > 0 ? MaxRatioCorrection : -MaxRatioCorrection);
 	}
 
-	// check if delay has changed significantly (more than x percent)
-	double x = 0.1;
-	if (lastDelayInBytes != 0 &&
-		abs((double)(lastDelayInBytes - delayInBytes) / (double)lastDelayInBytes) > x)
-		bufferReadPtr_ = bufferWriterPtr_%bufferSize_ - delayInBytes;
+	ratio_ = resampler_.getNominalRatio() * (1 + correction);
 }
 
-void YouTubeCHOP::freeBuffer()
+// consumer side, call on cook thread only
+void YouTubeCHOP::resetAudio()
 {
-	if (audioBuffer_)
-	{
-		ScopedLock lock(bufferAccess_);
-		free(audioBuffer_);
-		bufferSize_ = 0;
-		bufferWriterPtr_ = 0;
-		bufferReadPtr_ = 0;
-	}
+	subscription_->poll();
+	subscription_->clear();
+	isPrimed_ = false;
 }
 
 void YouTubeCHOP::updateParameters(const CHOP_InputArrays * inputArrays)
 {
-	TouchInputHelper<CHOP_InputArrays, TouchInputName> inputHelper(TouchInputs);
+	inputHelper_.getStringValue(inputArrays, TouchInputName::TopPath, parameters_.topFullPath_);
+	inputHelper_.getFloatValue(inputArrays, TouchInputName::OutputRate, parameters_.outputRate_);
+	inputHelper_.getFloatValue(inputArrays, TouchInputName::Latency, parameters_.latencyMs_);
+
+	uint64_t generation = SharedData::getGeneration();
+
+	if (parameters_.topFullPath_ == boundPath_ && generation == bindingGeneration_)
+		return;
 
-	inputHelper.getStringValue(inputArrays, TouchInputName::TopPath, parameters_.topFullPath_);
-	YouTubeTOP* top = loadTop(parameters_.topFullPath_);
+	boundPath_ = parameters_.topFullPath_;
+	bindingGeneration_ = generation;
+
+	// bound TOP may be gone - don't touch it then
+	if (top_ && SharedData::getTop(topKey_) != top_)
+		top_ = nullptr;
+
+	std::string topKey;
+	YouTubeTOP* top = loadTop(parameters_.topFullPath_, topKey);
 
 	if (!top)
 	{
-		if (top_) top_->registerAudioCallback(nullptr);
+		if (top_) top_->unsubscribeAudio(subscription_);
 		top_ = nullptr;
-		freeBuffer();
+		resetAudio();
 		if (parameters_.topFullPath_ == "")
 			status_ = NotBinded;
 		else
@@ -374,13 +495,17 @@ void YouTubeCHOP::updateParameters(const CHOP_InputArrays * inputArrays)
 	{
 		if (top != top_)
 		{
-			if (top_) top_->registerAudioCallback(nullptr);
+			if (top_) top_->unsubscribeAudio(subscription_);
+			resetAudio();
 			top_ = top;
-			top_->registerAudioCallback(std::bind(&YouTubeCHOP::onAudioData, this, _1));
 		}
 
+		// no-op if subscribed already; new TOP may have taken old one's place
+		top_->subscribeAudio(subscription_);
 		status_ = Binded;
 	}
+
+	topKey_ = topKey;
 }
 
 std::string YouTubeCHOP::getMyPath()
@@ -405,15 +530,16 @@ std::string YouTubeCHOP::getMyPath()
 	return path.str();
 }
 
-YouTubeTOP * YouTubeCHOP::loadTop(const std::string& topPath)
+YouTubeTOP * YouTubeCHOP::loadTop(const std::string& topPath, std::string& topKey)
 {
 	// try whatever we have in full path as a full path...
-	YouTubeTOP *top = SharedData::getTop(topPath);
+	topKey = topPath;
+	YouTubeTOP *top = SharedData::getTop(topKey);
 
 	if (!top)
 	{ // now try using our path and topFullPath_ as TOP name...
-		std::string fullTopPath = getMyPath() + "/" + topPath;
-		top = SharedData::getTop(fullTopPath);
+		topKey = getMyPath() + "/" + topPath;
+		top = SharedData::getTop(topKey);
 	}
 
 	return top;
@@ -22,8 +22,13 @@
 #define __youtube_chop_h__
 
 #include <string>
+#include <memory>
 #include "CHOP_CPlusPlusBase.h"
 #include "stream_controller.h"
+#include "audio_subscription.h"
+#include "resampler.h"
+#include "touch_helpers.h"
+#include "allocation_counter.h"
 
 /*
 This class works in conjunction with YouTubeTOP. It retrieves audio data from
@@ -59,6 +64,14 @@ public:
 	virtual void		getInfoDATEntries(int index,
 		int nEntries,
 		CHOP_InfoDATEntries *entries);
+
+	// TouchDesigner's inputs used by this CHOP
+	enum class TouchInputName {
+		TopPath,
+		OutputRate,
+		Latency
+	};
+
 private:
 	typedef enum _Status {
 		NotBinded,
@@ -68,6 +81,10 @@ private:
 
 	typedef struct _Parameters {
 		std::string topFullPath_;
+		// 0 means stream's own rate
+		float outputRate_;
+		// fill level to hold; 0 means follow VLC's playback delay
+		float latencyMs_;
 	} Parameters;
 
 	const CHOP_NodeInfo		*myNodeInfo;
@@ -75,24 +92,31 @@ private:
 
 	Status status_;
 	Parameters parameters_;
-	vlc::StreamController::Status::AudioInfo audioInfo_;
-	long long bufferWriterPtr_, bufferReadPtr_;
-	unsigned bufferSize_, bufferSampleSize_;
-	//unsigned nWroteBytes_, nReadBytes_;
-	int16_t* audioBuffer_;
+	TouchInputHelper<CHOP_InputArrays, TouchInputName> inputHelper_;
 	YouTubeTOP* top_;
-	std::mutex bufferAccess_;
-	int64_t lastDelay_;
-
-	void onAudioData(vlc::StreamController::AudioData ad);
-
-	void makeBuffer(const uint64_t& delay, 
-		const vlc::StreamController::Status::AudioInfo& ai);
-	void freeBuffer();
+	// SharedData key top_ is registered with
+	std::string topKey_;
+	// binding is resolved again only if path or SharedData generation changes
+	std::string boundPath_;
+	uint64_t bindingGeneration_;
+
+	// our read cursor over audio blocks of the bound TOP
+	std::shared_ptr<audio::Subscription> subscription_;
+	unsigned formatVersion_;
+	bool isPrimed_;
+	// drift compensation: ratio is steered to hold fill level
+	audio::Resampler resampler_;
+	double ratio_, delayAverage_, errorAverage_, errorIntegral_;
+	// allocations on cook thread during last cook (YT_COUNT_ALLOCATIONS)
+	CookAllocations cookAllocations_;
+
+	void cook(const CHOP_Output* output, const CHOP_InputArrays* inputs);
+	void resetAudio();
+	void updateRatio(size_t fill, size_t target, double dt);
 
 	void updateParameters(const CHOP_InputArrays* inputArrays);
 	std::string getMyPath();
-	YouTubeTOP* loadTop(const std::string& topPath);
+	YouTubeTOP* loadTop(const std::string& topPath, std::string& topKey);
 
 	static std::string getStatusString(Status s);
 };
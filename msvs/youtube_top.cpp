@@ -33,6 +33,9 @@
 
 #include "touch_helpers.h"
 #include "shared_data.h"
+#include "instance_pool.h"
+#include "media_memory.h"
+#include "allocation_counter.h"
 
 using namespace vlc;
 using namespace std::placeholders;
@@ -54,6 +57,11 @@ default:
 
 
 static int nTOPInstances = 0;
+// staged handover frame may be this far off start time - seeks aren't exact
+static const int64_t HandoverStageToleranceMs = 250;
+// cooks which still run once TOP goes idle, so that queued transport 
+// commands (i.e. pause) take effect and last frame makes it to the output
+static const int IdleCooks = 3;
 
 /**
  * This enum identifies output DAT's different fields
@@ -85,7 +93,8 @@ enum class InfoDatIndex {
 	ThumbnailOn,
 	LibVersion,
 	FPS,
-	CurrentTime
+	CurrentTime,
+	MemoryClips
 };
 
 /**
@@ -113,7 +122,14 @@ enum class InfoChopIndex {
 	ThumbnailOn,
 	FPS,
 	CurrentTime,
-	nInstances
+	nInstances,
+	UploadMode,
+	ChromaMode,
+	SharedStream,
+	LoopCache,
+	Prefetched,
+	Transition,
+	Allocations
 };
 
 /**
@@ -126,7 +142,8 @@ static std::map<InfoDatIndex, std::string> RowNames = {
 		{ InfoDatIndex::TopStatus, "TOPstatus" },
 		{ InfoDatIndex::HandoverState, "handoverState" },
 		{ InfoDatIndex::Thumbnail, "thumbnail" },
-		{ InfoDatIndex::LibVersion, "libVersion" }
+		{ InfoDatIndex::LibVersion, "libVersion" },
+		{ InfoDatIndex::MemoryClips, "memoryClips" }
 };
 
 /**
@@ -151,49 +168,54 @@ static std::map<InfoChopIndex, std::string> ChanNames = {
 	{ InfoChopIndex::ThumbnailOn, "thumbnailOn" },
 	{ InfoChopIndex::FPS, "framerate" },
 	{ InfoChopIndex::CurrentTime, "currentTime" },
-	{ InfoChopIndex::nInstances, "nInstances" }
+	{ InfoChopIndex::nInstances, "nInstances" },
+	{ InfoChopIndex::UploadMode, "uploadMode" },
+	{ InfoChopIndex::ChromaMode, "chromaMode" },
+	{ InfoChopIndex::SharedStream, "sharedStream" },
+	{ InfoChopIndex::LoopCache, "loopCache" },
+	{ InfoChopIndex::Prefetched, "prefetched" },
+	{ InfoChopIndex::Transition, "transition" },
+	{ InfoChopIndex::Allocations, "allocations" }
 };
 
-/**
- * This enum identifies all TouchDesigner's inputs that are
- * used in this CPlusPlusTOP
- */
-enum class TouchInputName {
-	URL,
-	Pause,
-	Loop,
-	SeekPosition,
-	SwitchOnCue,
-	SwitchCue,
-	PlaybackSpeed,
-	StartTime,
-	EndTime,
-	Blackout,
-	Thumbnail,
-	ThumbnailOn
-};
+typedef YouTubeTOP::TouchInputName TouchInputName;
 
 /**
- * This maps touch inputs to their textual names in TouchDesigner
+ * This maps touch inputs to their textual names in TouchDesigner.
+ * Entries follow the order of TouchInputName.
  */
- static std::map<TouchInputName, TouchInput> TouchInputs = {
-		 { TouchInputName::URL, { "string0", 0, 0 } },
-		 { TouchInputName::Loop, { "value0", 0, 0 } },
-		 { TouchInputName::Pause, { "value0", 0, 1 } },
-		 { TouchInputName::Blackout, { "value0", 0, 2 } },
-		 { TouchInputName::SeekPosition, { "value2", 2, 0 } },
-		 { TouchInputName::SwitchOnCue, { "value3", 3, 0 } },
-		 { TouchInputName::SwitchCue, { "value3", 3, 1 } },
-		 { TouchInputName::PlaybackSpeed, { "value4", 4, 0 } },
-		 { TouchInputName::StartTime, { "value5", 5, 0 } },
-		 { TouchInputName::EndTime, { "value5", 5, 1 } },
-		 { TouchInputName::Thumbnail, { "string1", 1, 0 } },
-		 { TouchInputName::ThumbnailOn, { "value6", 6, 0 } }
+static constexpr TouchInput<TouchInputName> TouchInputs[] = {
+	{ TouchInputName::URL, "string0", 0, 0 },
+	{ TouchInputName::Pause, "value0", 0, 1 },
+	{ TouchInputName::Loop, "value0", 0, 0 },
+	{ TouchInputName::SeekPosition, "value2", 2, 0 },
+	{ TouchInputName::SwitchOnCue, "value3", 3, 0 },
+	{ TouchInputName::SwitchCue, "value3", 3, 1 },
+	{ TouchInputName::PlaybackSpeed, "value4", 4, 0 },
+	{ TouchInputName::StartTime, "value5", 5, 0 },
+	{ TouchInputName::EndTime, "value5", 5, 1 },
+	{ TouchInputName::Blackout, "value0", 0, 2 },
+	{ TouchInputName::Thumbnail, "string1", 1, 0 },
+	{ TouchInputName::ThumbnailOn, "value6", 6, 0 },
+	{ TouchInputName::AsyncUpload, "value7", 7, 0 },
+	{ TouchInputName::ChromaMode, "value8", 8, 0 },
+	{ TouchInputName::FitOutput, "value9", 9, 0 },
+	{ TouchInputName::MemoryClipSize, "value10", 10, 0 },
+	{ TouchInputName::LoopCacheSec, "value11", 11, 0 },
+	{ TouchInputName::Playlist, "string2", 2, 0 },
+	{ TouchInputName::PlaylistIndex, "value12", 12, 0 },
+	{ TouchInputName::PrefetchDepth, "value12", 12, 1 },
+	{ TouchInputName::PrefetchBudget, "value13", 13, 0 },
+	{ TouchInputName::ParallelPrefetches, "value13", 13, 1 },
+	{ TouchInputName::TransitionType, "value14", 14, 0 },
+	{ TouchInputName::TransitionTime, "value14", 14, 1 }
 };
 
-int createVideoTexture(unsigned width, unsigned height, void *frameBuffer);
-void renderTexture(GLuint texId, unsigned width, unsigned height, void* data);
+static_assert(isWiringOrdered(TouchInputs), "TouchInputs must follow the order of TouchInputName");
+
 bool fileExist(const char *fileName);
+// overwrites idx-th string in place, growing list if needed
+static void assignUrl(std::vector<std::string>& urls, size_t idx, const std::string& url);
 
 // These functions are basic C function, which the DLL loader can find
 // much easier than finding a C++ Class.
@@ -206,6 +228,10 @@ DLLEXPORT
 int
 GetTOPAPIVersion(void)
 {
+	// called right after the DLL is loaded (and not under the loader lock) -
+	// create VLC instances now, so that creating nodes doesn't have to
+	InstancePool::warmUp();
+
 	// Always return TOP_CPLUSPLUS_API_VERSION in this function.
 	return TOP_CPLUSPLUS_API_VERSION;
 }
@@ -268,23 +294,58 @@ std::string YouTubeTOP::getHandoverStatusString(YouTubeTOP::HandoverStatus statu
 
 #pragma mark - public
 YouTubeTOP::YouTubeTOP(const TOP_NodeInfo *info) : 
-streamControllers_("main", "spare"),
+streamControllers_(),
+prefetcher_([this](){ return streamControllers_.acquire(); },
+	[this](StreamController* c){ streamControllers_.release(c); },
+	std::bind(&YouTubeTOP::startPrefetch, this, _1, _2)),
 myNodeInfo(info), 
 videoFormatReady_(false),
 status_(Status::None), 
 handoverStatus_(HandoverStatus::NoHandover), 
-parameters_({ "", "", false, false, false, false, 0., 0., false, false, 0., false, 0., false, 0., false}), 
-activeController_(streamControllers_.getFirst()),
-handoverController_(streamControllers_.getSecond()),
+parameters_({ "", "", false, false, false, false, 0., 0., false, false, 0., false, 0., false, 0., false, false, true, false, 64., 0., false, 0., "", 0., 2., 512., 1., 0., 0.}), 
+inputHelper_(TouchInputs),
+activeController_(streamControllers_.acquire()),
+handoverController_(streamControllers_.acquire()),
 thumbnailController_(new vlc::StreamController("thumbnail")),
+chroma_(StreamController::RGBA),
+maxWidth_(0),
+maxHeight_(0),
 needAdjustStartTimeActive_(false),
 needAdjustStartTimeHandover_(false),
 activeInfoStaled_(false),
 handoverInfoStaled_(false),
 cookNextFrames_(1),
-thumbnailReady_(false)
+isFrameUpdated_(false),
+thumbnailReady_(false),
+frameCallback_(std::bind(&YouTubeTOP::onFrameRendering, this, _1, _2)),
+thumbnailCallback_(std::bind(&YouTubeTOP::onThumbnailRendering, this, _1, _2)),
+audioCallback_(std::bind(&YouTubeTOP::onAudioData, this, _1, _2)),
+texture_(),
+thumbnail_(),
+stagingTexture_(),
+isHandoverStaged_(false),
+handoverSeekFrameNo_(0),
+lastThumbnailFrameNo_(0),
+transition_(),
+outgoingTexture_(),
+outgoingController_(nullptr),
+outgoingFrameNo_(0),
+startTimeMs_(0),
+leader_(nullptr),
+leaderGeneration_(0),
+lastFrameSource_(nullptr),
+lastFrameNo_(0),
+resumeTimeMs_(-1),
+loopCacheArmed_(false),
+isPlayingLoopCache_(false),
+loopTimeMs_(0),
+lastLoopFrameIdx_(-1),
+cookAllocations_(),
+streamKey_()
 {
 	SharedData::addTop(this);
+	// first transition takes it
+	streamControllers_.reserveSpare();
 
 	myExecuteCount = 0;
 	nTOPInstances++;
@@ -293,6 +354,9 @@ thumbnailReady_(false)
 
 YouTubeTOP::~YouTubeTOP()
 {
+	// followers notice we're gone and start decoding on their own
+	StreamRegistry::withdraw(this);
+	leaveLeader();
 	SharedData::removeTop(this);
 	nTOPInstances--;
 }
@@ -300,21 +364,32 @@ YouTubeTOP::~YouTubeTOP()
 void
 YouTubeTOP::getGeneralInfo(TOP_GeneralInfo *ginfo)
 {
-	//log("getGeneralInfo() cook next %d", cookNextFrames_);
-	// Uncomment this line if you want the TOP to cook every frame even
-	// if none of it's inputs/parameters are changing.
-	ginfo->cookEveryFrame = true; // cookNextFrames_ > 0; // !parameters_.isPaused_ && !thumbnailReady_;
 	ginfo->cookEveryFrameIfAsked = true;
-	activeControllerStatus_ = activeController_->getStatus();
-	handoverControllerStatus_ = handoverController_->getStatus();
-	thumbnailControllerStatus_ = thumbnailController_->getStatus();
+
+	// cook paths shouldn't allocate once playback has settled
+	cookAllocations_.begin(isSteadyState());
+
+	YouTubeTOP* leader = getLeader();
+
+	(leader ? leader->activeController_ : activeController_)->getStatus(activeControllerStatus_);
+	handoverController_->getStatus(handoverControllerStatus_);
+	thumbnailController_->getStatus(thumbnailControllerStatus_);
 
 	if (status_ > None)
 	{
 		ginfo->clearBuffers = false;
 	}
 
-	cookNextFrames_--;
+	// TD can't be woken up by decoder, so TOP cooks every frame only while 
+	// new frames may come; otherwise it cooks on parameter changes only
+	if (needsCooking())
+		cookNextFrames_ = IdleCooks;
+
+	//log("getGeneralInfo() cook next %d", cookNextFrames_);
+	ginfo->cookEveryFrame = (cookNextFrames_ > 0);
+
+	if (cookNextFrames_ > 0)
+		cookNextFrames_--;
 }
 
 bool
@@ -327,6 +402,25 @@ YouTubeTOP::getOutputFormat(TOP_OutputFormat *format)
 	// specified.
 	// In this example we'll return false and use the TOP's settings
 
+	// format comes pre-filled with TOP's own resolution - there's no point
+	// in decoding more pixels than that
+	{
+		unsigned maxWidth = (parameters_.fitToOutput_ ? (unsigned)format->width : 0);
+		unsigned maxHeight = (parameters_.fitToOutput_ ? (unsigned)format->height : 0);
+
+		streamControllers_.forEach([maxWidth, maxHeight](StreamController* c){
+			c->setMaxResolution(maxWidth, maxHeight);
+		});
+
+		// current stream is rescaled - followers of old size decode on their own
+		if (maxWidth != maxWidth_ || maxHeight != maxHeight_)
+		{
+			maxWidth_ = maxWidth;
+			maxHeight_ = maxHeight;
+			republishStream();
+		}
+	}
+
 	{
 		if (activeControllerStatus_.isVideoInfoReady_)
 		{
@@ -351,33 +445,36 @@ YouTubeTOP::getOutputFormat(TOP_OutputFormat *format)
 			format->aspectY = (float)activeControllerStatus_.videoInfo_.height_;
 		}
 
-		if (needAdjustStartTimeActive_ &&
+		if (needAdjustStartTimeActive_ && !leader_ &&
 			activeControllerStatus_.isVideoInfoReady_)
 		{
-			if (startTimeMs_ < activeControllerStatus_.videoInfo_.totalTime_)
+			// after leaving shared stream, continue where it was
+			int seekMs = (resumeTimeMs_ >= 0 ? resumeTimeMs_ : startTimeMs_);
+
+			if (seekMs < activeControllerStatus_.videoInfo_.totalTime_)
 			{
-				log("seek active to %d. buffer %.2f", startTimeMs_, activeControllerStatus_.videoInfo_.bufferLevel_);
+				log("seek active to %d. buffer %.2f", seekMs, activeControllerStatus_.videoInfo_.bufferLevel_);
 
-				activeController_->seekMs(startTimeMs_);
+				activeController_->seekMs(seekMs);
 			}
 			else
-				log("startTime (%d) exceeds video length (%d). ignore seeking for active", startTimeMs_, activeControllerStatus_.videoInfo_.totalTime_);
+				log("startTime (%d) exceeds video length (%d). ignore seeking for active", seekMs, activeControllerStatus_.videoInfo_.totalTime_);
 
 			needAdjustStartTimeActive_ = false;
+			resumeTimeMs_ = -1;
 		}
 
 
 		if (handoverControllerStatus_.isVideoInfoReady_ &&
 			!handoverInfoStaled_)
 		{
-			log("handover video info ready. pausing");
+			log("handover video info ready. decoding first frame");
 
 			handoverInfoStaled_ = true;
-			handoverController_->pause(true);
+			// prefetched one may be paused - it's paused again once staged
+			handoverController_->pause(false);
 		}
 
-		bool adjustedHandover = false;
-
 		if (needAdjustStartTimeHandover_ &&
 			handoverControllerStatus_.isVideoInfoReady_)
 		{
@@ -385,24 +482,18 @@ YouTubeTOP::getOutputFormat(TOP_OutputFormat *format)
 			{
 				log("seek handover to %d. buffr %.2f", startTimeMs_, handoverControllerStatus_.videoInfo_.bufferLevel_);
 
+				// frames decoded so far are from before the seek
+				StreamController::FrameRef frame = handoverController_->getLatestFrame();
+
+				handoverSeekFrameNo_ = (frame ? frame.frameNo() : 0);
+				isHandoverStaged_ = false;
 				handoverController_->seekMs(startTimeMs_);
-				adjustedHandover = true;
 			}
 			else
 				log("startTime (%d) exceeds video length (%d). ignore seeking for handover", startTimeMs_, handoverControllerStatus_.videoInfo_.totalTime_);
 
 			needAdjustStartTimeHandover_ = false;
 		}
-
-
-		if (handoverStatus_ == HandoverStatus::Initiated &&
-			handoverControllerStatus_.videoInfo_.bufferLevel_ >= 90 &&
-			!adjustedHandover)
-		{
-			log("finishing up handover. buffer %.2f", handoverControllerStatus_.videoInfo_.bufferLevel_);
-
-			handoverStatus_ = HandoverStatus::Ready;
-		}
 	}
 	
 	// if thumbnail is on, set format
@@ -430,35 +521,97 @@ YouTubeTOP::getOutputFormat(TOP_OutputFormat *format)
 
 void
 YouTubeTOP::execute(const TOP_OutputFormatSpecs* outputFormat, const TOP_InputArrays* arrays, void* reserved)
+{
+	cook(outputFormat, arrays);
+	cookAllocations_.end(isSteadyState(), myNodeInfo->nodeFullPath);
+}
+
+void
+YouTubeTOP::cook(const TOP_OutputFormatSpecs* outputFormat, const TOP_InputArrays* arrays)
 {
 	updateParameters(arrays);
+	texture_.setAsync(parameters_.asyncUpload_);
+	thumbnail_.setAsync(parameters_.asyncUpload_);
+
+	// short clips loop from RAM; info DAT reports if libvlc can't do it
+	if (MediaMemory::isSupported())
+	{
+		uint64_t memoryClipSize = (uint64_t)(std::max(parameters_.memoryClipSizeMb_, 0.f) * (1 << 20));
+		streamControllers_.forEach([memoryClipSize](StreamController* c){
+			c->setMaxMemoryClipSize(memoryClipSize);
+		});
+	}
+
+	if (parameters_.isNewChromaMode_)
+	{
+		parameters_.isNewChromaMode_ = false;
+
+		// thumbnail is a still frame - keep it RGBA
+		int mode = std::min(std::max((int)parameters_.lastChromaMode_, (int)StreamController::RGBA), (int)StreamController::NV12);
+		StreamController::Chroma chroma = (StreamController::Chroma)mode;
+
+		if (!VideoTexture::isChromaSupported(chroma))
+		{
+			log("chroma %s is not supported. falling back to RGBA", StreamController::getChromaString(chroma).c_str());
+			chroma = StreamController::RGBA;
+		}
+
+		// applies to the next URL loaded by the controllers, stream is
+		// published under new key then
+		if (chroma != chroma_)
+			StreamRegistry::withdraw(this);
+		chroma_ = chroma;
+		streamControllers_.forEach([chroma](StreamController* c){
+			c->setChroma(chroma);
+		});
+	}
 	//log("execute()");
 
 	myExecuteCount++;
 
+	updatePrefetcher();
+
+	// refilled between switches - performTransition() takes the spare
+	if (!transition_.isActive())
+		streamControllers_.reserveSpare();
+
+	// blend is over or there's nothing to blend into anymore
+	if (transition_.isActive() &&
+		(transition_.isFinished() || status_ != Running || parameters_.thumbnailOn_))
+		finishTransition();
+
 	bool needLoad = false;
 
-	needLoad = (parameters_.currentUrl_ != activeControllerStatus_.videoUrl_) && (parameters_.currentUrl_ != handoverControllerStatus_.videoUrl_);
+	// status of shared stream is leader's; our own controllers are idle
+	needLoad = (getLeader() != nullptr) ||
+		((parameters_.currentUrl_ != activeControllerStatus_.videoUrl_) && (parameters_.currentUrl_ != handoverControllerStatus_.videoUrl_));
 
 	if (parameters_.isNewStartTime_)
 	{
 		parameters_.isNewStartTime_ = false;
+		// stream key changes
+		StreamRegistry::withdraw(this);
 		startTimeMs_ = 0;
 		startTimeMs_ = (int)round(parameters_.lastStartTimeSec_ * 1000.);
+		// cached pass starts elsewhere
+		stopLoopCache();
+		loopCache_.reset();
 		needAdjustStartTimeActive_ = (startTimeMs_ > activeControllerStatus_.videoInfo_.currentTime_) || !activeControllerStatus_.isVideoInfoReady_;
 		needAdjustStartTimeHandover_ = true;
+		// staged frame is from old start time
+		resetHandoverStage();
 
 		log("new start time %d adjust active %d adjust handover %d", startTimeMs_, needAdjustStartTimeActive_, needAdjustStartTimeHandover_);
 	}
 
-	if (parameters_.thumbnailUrl_ != thumbnailController()->getStatus().videoUrl_)
+	if (parameters_.thumbnailUrl_ != thumbnailControllerStatus_.videoUrl_)
 	{
 		if (parameters_.thumbnailUrl_ == "")
 			thumbnailController()->stop();
 		else
 		{
 			thumbnailController()->play(parameters_.thumbnailUrl_, 
-				std::bind(&YouTubeTOP::onThumbnailRendering, this, _1, _2),
+				thumbnailCallback_,
 				nullptr,
 				thumbnailController());
 			log("requested thumbnail - %s", parameters_.thumbnailUrl_.c_str());
@@ -480,18 +633,24 @@ YouTubeTOP::execute(const TOP_OutputFormatSpecs* outputFormat, const TOP_InputAr
 		{
 			thumbnailController()->seek(0);
 			thumbnailController()->play();
-			cookNextFrames_ = INT_MAX;
 		}
 		else
 		{
 			status_ = ReadyToRun;
 			thumbnailController()->pause(true);
-			cookNextFrames_ = 0;
 		}
 	}
 
 	if (needLoad)
 	{
+		StreamRegistry::withdraw(this);
+
+		if (followLeader())
+		{
+			renderLeaderFrame();
+			return;
+		}
+
 		if (parameters_.currentUrl_ == "")
 		{
 			status_ = Status::None;
@@ -499,24 +658,32 @@ YouTubeTOP::execute(const TOP_OutputFormatSpecs* outputFormat, const TOP_InputAr
 			isFrameUpdated_ = false;
 			activeController_->stop();
 			handoverController_->stop();
+			resetHandoverStage();
+			finishTransition();
 			renderBlackFrame();
-			cookNextFrames_ = 0;
 
 			log("empty url - rendering black frame");
 		}
 		else
 		{
+			// prefetches have played a bit before they were paused
+			bool isPrefetched = false;
+
 			if (status_ == Running)
 			{
 				if (handoverStatus_ != Initiated ||
 					(handoverStatus_ == Initiated && parameters_.currentUrl_ != handoverControllerStatus_.videoUrl_))
 				{
 					handoverStatus_ = Initiated;
-					handoverController_->play(parameters_.currentUrl_,
-						std::bind(&YouTubeTOP::onFrameRendering, this, _1, _2),
-						std::bind(&YouTubeTOP::onAudioData, this, _1, _2),
-						handoverController_);
-					handoverInfoStaled_ = false;
+
+					// prefetched one is resumed until its first frame is staged
+					isPrefetched = takePrefetched(&handoverController_, handoverControllerStatus_);
+					if (!isPrefetched)
+						handoverController_->play(parameters_.currentUrl_,
+							frameCallback_,
+							audioCallback_,
+							handoverController_);
+					resetHandoverStage();
 
 					log("initiated handover for URL %s", parameters_.currentUrl_.c_str());
 				}
@@ -525,23 +692,29 @@ YouTubeTOP::execute(const TOP_OutputFormatSpecs* outputFormat, const TOP_InputAr
 			{
 				status_ = Status::None;
 				isFrameUpdated_ = false;
-				activeController_->play(parameters_.currentUrl_, 
-					std::bind(&YouTubeTOP::onFrameRendering, this, _1, _2), 
-					std::bind(&YouTubeTOP::onAudioData, this, _1, _2),
-					activeController_);
+
+				bool isActivePrefetched = takePrefetched(&activeController_, activeControllerStatus_);
+
+				if (!isActivePrefetched)
+					activeController_->play(parameters_.currentUrl_, 
+						frameCallback_, 
+						audioCallback_,
+						activeController_);
 				handoverController_->play(parameters_.currentUrl_,
-					std::bind(&YouTubeTOP::onFrameRendering, this, _1, _2), 
-					std::bind(&YouTubeTOP::onAudioData, this, _1, _2),
+					frameCallback_, 
+					audioCallback_,
 					handoverController_);
-				needAdjustStartTimeActive_ = (startTimeMs_ != 0);
+				needAdjustStartTimeActive_ = (startTimeMs_ != 0 || resumeTimeMs_ > 0 || isActivePrefetched);
 				activeInfoStaled_ = false;
-				handoverInfoStaled_ = false;
-				cookNextFrames_ = INT_MAX;
+				resetHandoverStage();
+
+				if (StreamRegistry::publish(getStreamKey(), this))
+					log("sharing stream with other TOPs");
 
 				log("initiated playback for active and handover: %s", parameters_.currentUrl_.c_str());
 			}
 			
-			needAdjustStartTimeHandover_ = (startTimeMs_ != 0);
+			needAdjustStartTimeHandover_ = (startTimeMs_ != 0 || isPrefetched);
 
 			log("need adjust active: %d handover %d", needAdjustStartTimeActive_, needAdjustStartTimeHandover_);
 		}
@@ -553,12 +726,13 @@ YouTubeTOP::execute(const TOP_OutputFormatSpecs* outputFormat, const TOP_InputAr
 		bool canSwitch = parameters_.seamlessModeOn_ || 
 						!parameters_.seamlessModeOn_ && parameters_.switchCue_;
 
+		stageHandoverFrame();
+
 		if (handoverStatus_ == Ready && canSwitch)
 		{
 			log("handover ready. switching...");
 
 			performTransition();
-			handoverInfoStaled_ = false;
 			needAdjustStartTimeHandover_ = true;
 		}
 
@@ -569,18 +743,41 @@ YouTubeTOP::execute(const TOP_OutputFormatSpecs* outputFormat, const TOP_InputAr
 			if (parameters_.isNewSeekValue_)
 			{
 				parameters_.isNewSeekValue_ = false;
-				activeController_->seek(parameters_.lastSeekPosition_);
+
+				if (isPlayingLoopCache_)
+					loopTimeMs_ = parameters_.lastSeekPosition_ * loopCache_.getDuration();
+				else
+				{
+					activeController_->seek(parameters_.lastSeekPosition_);
+
+					// pass being recorded isn't contiguous anymore
+					if (loopCache_.getState() == LoopCache::Recording)
+						loopCache_.reset();
+				}
+
+				// followers keep their own timeline
+				StreamRegistry::withdraw(this);
 			}
 
 			if (parameters_.isNewPlaybackSpeed_)
 			{
 				parameters_.isNewPlaybackSpeed_ = false;
+				StreamRegistry::withdraw(this);
 				activeController_->setPlaybackSpeed(parameters_.lastPlaybackSpeed_);
 				handoverController_->setPlaybackSpeed(parameters_.lastPlaybackSpeed_);
 			}
 
 			status_ = (parameters_.isPaused_) ? ReadyToRun : Running;
-			cookNextFrames_ = (status_ == ReadyToRun) ? 0 : INT_MAX;
+
+			if (parameters_.loopCacheSec_ <= 0 && loopCache_.getState() != LoopCache::Idle)
+			{
+				stopLoopCache();
+				loopCache_.reset();
+			}
+
+			// cached loop doesn't advance while paused
+			if (status_ != Running)
+				lastLoopTick_ = std::chrono::steady_clock::now();
 
 			if (status_ == Running)
 			{
@@ -589,21 +786,39 @@ YouTubeTOP::execute(const TOP_OutputFormatSpecs* outputFormat, const TOP_InputAr
 				case libvlc_Error:{
 					log("player has encountered error");
 					status_ = ReadyToRun;
-					cookNextFrames_ = 0;
 				}
 					break;
 				case libvlc_Ended:
 				{
-					if (parameters_.isLooping_)
+					// cached pass is video only - it ends like decoded one once
+					// loop is turned off, and handover takes over if someone
+					// listens to audio
+					if (isPlayingLoopCache_ && (!parameters_.isLooping_ || hasAudioSubscribers()))
+					{
+						log("leaving cached loop");
+						stopLoopCache();
+					}
+
+					if (parameters_.isLooping_ && !isPlayingLoopCache_)
 					{
+						if (loopCache_.getState() == LoopCache::Recording)
+							loopCache_.finish();
+
+						if (loopCache_.getState() == LoopCache::Ready &&
+							loopCache_.getUrl() == activeControllerStatus_.videoUrl_ &&
+							!hasAudioSubscribers())
+						{
+							startLoopCache();
+							break;
+						}
+
 						log("active ended");
 
-						if (handoverControllerStatus_.isVideoInfoReady_)
+						if (isHandoverStaged_)
 						{
 							log("performing transition...");
 
 							performTransition();
-							handoverInfoStaled_ = false;
 							needAdjustStartTimeHandover_ = true;
 							activeController_->pause(parameters_.isPaused_);
 						}
@@ -622,13 +837,29 @@ YouTubeTOP::execute(const TOP_OutputFormatSpecs* outputFormat, const TOP_InputAr
 			{
 				if (parameters_.blackout_)
 					renderBlackFrame();
+				else if (isPlayingLoopCache_)
+					renderLoopCacheFrame();
+				else if (transition_.isActive())
+					renderTransitionFrame();
 				else
 				{
-					ScopedLock lock(frameBufferAcces_);
-					if (isFrameUpdated_)
+					if (isFrameUpdated_.exchange(false))
 					{
-						isFrameUpdated_ = false;
-						renderTexture(texture_, activeControllerStatus_.videoInfo_.width_, activeControllerStatus_.videoInfo_.height_, frameData_);
+						// upload straight from decoder's frame slot
+						StreamController::FrameRef frame = activeController_->getLatestFrame();
+
+						if (frame && 
+							frame.width() == activeControllerStatus_.videoInfo_.width_ &&
+							frame.height() == activeControllerStatus_.videoInfo_.height_)
+						{
+							// format was renegotiated for new output size
+							if (frame.width() != texture_.getWidth() || frame.height() != texture_.getHeight())
+								initTexture();
+
+							texture_.upload(frame);
+							texture_.draw(frame.width(), frame.height());
+							recordLoopFrame(frame);
+						}
 					}
 				}
 			}
@@ -638,7 +869,6 @@ YouTubeTOP::execute(const TOP_OutputFormatSpecs* outputFormat, const TOP_InputAr
 			if (activeControllerStatus_.state_ == libvlc_Error)
 			{
 				log("player encountered error before URL was opened.");
-				cookNextFrames_ = 0;
 			}
 		}
 	}
@@ -650,8 +880,21 @@ YouTubeTOP::execute(const TOP_OutputFormatSpecs* outputFormat, const TOP_InputAr
 				renderBlackFrame();
 			else
 			{
-				ScopedLock lock(thumbnailBufferAcces_);
-				renderTexture(thumbnail_, thumbnailControllerStatus().videoInfo_.width_, thumbnailControllerStatus().videoInfo_.height_, thumbnailFrameData_);
+				StreamController::FrameRef frame = thumbnailController()->getLatestFrame();
+
+				if (frame && 
+					frame.width() == thumbnailControllerStatus().videoInfo_.width_ &&
+					frame.height() == thumbnailControllerStatus().videoInfo_.height_)
+				{
+					// paused thumbnail keeps giving the same frame
+					if (frame.frameNo() != lastThumbnailFrameNo_)
+					{
+						thumbnail_.upload(frame);
+						lastThumbnailFrameNo_ = frame.frameNo();
+					}
+
+					thumbnail_.draw(frame.width(), frame.height());
+				}
 			}
 		}
 	}
@@ -733,6 +976,27 @@ YouTubeTOP::getInfoCHOPChan(int index, TOP_InfoCHOPChan *chan)
 		case InfoChopIndex::nInstances:
 			chan->value = nTOPInstances;
 			break;
+		case InfoChopIndex::UploadMode:
+			chan->value = (float)texture_.getUploadMode();
+			break;
+		case InfoChopIndex::ChromaMode:
+			chan->value = (float)texture_.getChroma();
+			break;
+		case InfoChopIndex::SharedStream:
+			chan->value = (leader_ ? 1.f : 0.f);
+			break;
+		case InfoChopIndex::LoopCache:
+			chan->value = (float)loopCache_.getState();
+			break;
+		case InfoChopIndex::Prefetched:
+			chan->value = (float)prefetcher_.getNReady();
+			break;
+		case InfoChopIndex::Transition:
+			chan->value = (transition_.isActive() ? (float)transition_.getProgress() : 0.f);
+			break;
+		case InfoChopIndex::Allocations:
+			chan->value = (AllocationCounter::isEnabled() ? (float)cookAllocations_.get() : -1.f);
+			break;
 		default:
 			chan->value = -1;
 			break;
@@ -761,48 +1025,60 @@ YouTubeTOP::getInfoDATEntries(int index, int nEntries, TOP_InfoDATEntries *entri
 	// (so the buffers can be reuse for each column/row)
 	static char tempBuffer1[4096];
 	static char tempBuffer2[4096];
-	memset(tempBuffer1, 0, 4096);
-	memset(tempBuffer2, 0, 4096);
-
-	InfoDatIndex idx = (InfoDatIndex)index;
+	tempBuffer1[0] = tempBuffer2[0] = '\0';
 
-	if (RowNames.find(idx) != RowNames.end())
+	// rows are the named fields only, in order of InfoDatIndex
+	if (index >= 0 && index < (int)RowNames.size())
 	{
-		strcpy(tempBuffer1, RowNames[idx].c_str());
+		std::map<InfoDatIndex, std::string>::const_iterator row = RowNames.begin();
+		std::advance(row, index);
+
+		InfoDatIndex idx = row->first;
+
+		strcpy(tempBuffer1, row->second.c_str());
 		switch (idx)
 		{
 		case InfoDatIndex::LibVersion:
-			sprintf(tempBuffer2, "%s", libVersion_.c_str());
+			snprintf(tempBuffer2, sizeof(tempBuffer2), "%s", libVersion_.c_str());
 			break;
 		case InfoDatIndex::TopStatus:
 		{
 			std::string status = YouTubeTOP::getStatusString(status_);
-			sprintf(tempBuffer2, "%s", status.c_str());
+			snprintf(tempBuffer2, sizeof(tempBuffer2), "%s", status.c_str());
 		}
 			break;
 		case InfoDatIndex::State:
 		{
 			std::string state = StreamController::getStateString(activeControllerStatus_.state_);
-			sprintf(tempBuffer2, "%s", state.c_str());
+			snprintf(tempBuffer2, sizeof(tempBuffer2), "%s", state.c_str());
 		}
 			break;
 		case InfoDatIndex::URL:
-			sprintf(tempBuffer2, "%s", activeControllerStatus_.videoUrl_.c_str());
+			snprintf(tempBuffer2, sizeof(tempBuffer2), "%s", activeControllerStatus_.videoUrl_.c_str());
 			break;
 
 		case InfoDatIndex::HandoverState:
 		{
 			std::string state = getHandoverStatusString(handoverStatus_);
-			sprintf(tempBuffer2, "%s", state.c_str());
+			snprintf(tempBuffer2, sizeof(tempBuffer2), "%s", state.c_str());
 		}
 			break;
 
 		case InfoDatIndex::Thumbnail:
-			sprintf(tempBuffer2, "%s", parameters_.thumbnailUrl_.c_str());
+			snprintf(tempBuffer2, sizeof(tempBuffer2), "%s", parameters_.thumbnailUrl_.c_str());
+			break;
+
+		case InfoDatIndex::MemoryClips:
+			if (!MediaMemory::isSupported())
+				snprintf(tempBuffer2, sizeof(tempBuffer2), "%s", "unsupported (libvlc 3.0 required)");
+			else if (parameters_.memoryClipSizeMb_ > 0)
+				snprintf(tempBuffer2, sizeof(tempBuffer2), "up to %.0f MB", parameters_.memoryClipSizeMb_);
+			else
+				snprintf(tempBuffer2, sizeof(tempBuffer2), "%s", "off");
 			break;
 
 		default:
-			sprintf(tempBuffer2, "%s", "unknown");
+			snprintf(tempBuffer2, sizeof(tempBuffer2), "%s", "unknown");
 			break;
 		}
 	}
@@ -834,16 +1110,48 @@ std::string YouTubeTOP::getNodeFullPath() const
 	return std::string(myNodeInfo->nodeFullPath);
 }
 
-void YouTubeTOP::registerAudioCallback(AudioCallback callback)
+void YouTubeTOP::subscribeAudio(const std::shared_ptr<audio::Subscription>& subscription)
 {
-	ScopedLock lock(audioCallbackMutex_);
+	YouTubeTOP* leader = getLeader();
+
+	if (leader)
+		leader->subscribeAudio(subscription);
+
+	ScopedLock lock(audioSubscribersMutex_);
+	std::shared_ptr<const AudioSubscribers> subscribers = std::atomic_load(&audioSubscribers_);
+	std::shared_ptr<AudioSubscribers> updated = (subscribers ?
+		std::make_shared<AudioSubscribers>(*subscribers) : std::make_shared<AudioSubscribers>());
+
+	if (std::find(updated->begin(), updated->end(), subscription) == updated->end())
+		updated->push_back(subscription);
+
+	std::atomic_store(&audioSubscribers_, std::shared_ptr<const AudioSubscribers>(updated));
+}
+
+void YouTubeTOP::unsubscribeAudio(const std::shared_ptr<audio::Subscription>& subscription)
+{
+	YouTubeTOP* leader = getLeader();
+
+	if (leader)
+		leader->unsubscribeAudio(subscription);
+
+	ScopedLock lock(audioSubscribersMutex_);
+	std::shared_ptr<const AudioSubscribers> subscribers = std::atomic_load(&audioSubscribers_);
+
+	if (!subscribers)
+		return;
+
+	std::shared_ptr<AudioSubscribers> updated = std::make_shared<AudioSubscribers>(*subscribers);
 
-	audioCallback_ = callback;
+	updated->erase(std::remove(updated->begin(), updated->end(), subscription), updated->end());
+	std::atomic_store(&audioSubscribers_, std::shared_ptr<const AudioSubscribers>(updated));
 }
 
 bool YouTubeTOP::getIsPlaying()
 {
-	return (status_ == Running);
+	YouTubeTOP* leader = getLeader();
+
+	return (leader ? leader->getIsPlaying() : status_ == Running);
 }
 
 #pragma mark - private
@@ -852,13 +1160,9 @@ YouTubeTOP::onFrameRendering(const void* frameData, const void* userData)
 {
 	if (userData == activeController_)
 	{
-		if (status_ == Running && frameData_)
-		{
-			//log("copy frame");
-			ScopedLock lock(frameBufferAcces_);
-			memcpy(frameData_, frameData, activeControllerStatus_.videoInfo_.frameSize_);
+		// frame stays in controller's ring until execute() picks it up
+		if (status_ == Running && texture_.isValid())
 			isFrameUpdated_ = true;
-		}
 	}
 }
 
@@ -867,10 +1171,35 @@ void YouTubeTOP::onAudioData(const StreamController::AudioData ad, const void *
 #if 1
 	if (userData == activeController_)
 	{
-		ScopedLock lock(audioCallbackMutex_);
+		// audio thread never waits: if other controller's thread is here
+		// during handover, its block is dropped
+		std::unique_lock<std::mutex> lock(audioProducerMutex_, std::try_to_lock);
+
+		if (!lock.owns_lock())
+			return;
+
+		std::shared_ptr<const AudioSubscribers> subscribers = std::atomic_load(&audioSubscribers_);
+
+		if (!subscribers || subscribers->empty())
+			return;
+
+		// one copy for all subscribers. blocks hold whole frames
+		unsigned channels = std::max(ad.audioInfo_.channels_, 1u);
+		unsigned blockSamples = audio::Block::Capacity / channels * channels;
 
-		if (audioCallback_)
-			audioCallback_(ad);
+		for (unsigned offset = 0; offset < ad.nSamples_; offset += blockSamples)
+		{
+			audio::BlockPtr block = audio::Block::make(ad, offset, 
+				std::min(ad.nSamples_ - offset, blockSamples));
+
+			for (auto& s : *subscribers)
+			{
+				if (block)
+					s->push(block);
+				else
+					s->countOverflow();
+			}
+		}
 	}
 #endif
 }
@@ -878,152 +1207,405 @@ void YouTubeTOP::onAudioData(const StreamController::AudioData ad, const void *
 void 
 YouTubeTOP::onThumbnailRendering(const void* frameData, const void* userData)
 {
-	if (parameters_.thumbnailOn_ && thumbnail_)
-	{
-		ScopedLock lock(thumbnailBufferAcces_);
-		memcpy(thumbnailFrameData_, frameData, thumbnailControllerStatus().videoInfo_.frameSize_);
+	if (parameters_.thumbnailOn_ && thumbnail_.isValid())
 		thumbnailReady_ = true;
-	}
 }
 
 void 
 YouTubeTOP::initTexture()
 {
-	ScopedLock lock(frameBufferAcces_);
+	log("creating new texture (%dX%d %s)...", activeControllerStatus_.videoInfo_.width_, activeControllerStatus_.videoInfo_.height_,
+		StreamController::getChromaString(activeControllerStatus_.videoInfo_.chroma_).c_str());
+	texture_.init(activeControllerStatus_.videoInfo_.chroma_, activeControllerStatus_.videoInfo_.width_, activeControllerStatus_.videoInfo_.height_);
+	GetError();
+	log("new texture created");
+}
+
+void
+YouTubeTOP::initThumbnailTexture()
+{
+	log("creating new texture (%dX%d)...", thumbnailControllerStatus_.videoInfo_.width_, thumbnailControllerStatus_.videoInfo_.height_);
+	thumbnail_.init(thumbnailControllerStatus_.videoInfo_.chroma_, thumbnailControllerStatus_.videoInfo_.width_, thumbnailControllerStatus_.videoInfo_.height_);
+	lastThumbnailFrameNo_ = 0;
+	GetError();
+	log("new texture created");
+}
+
+void
+YouTubeTOP::updateParameters(const TOP_InputArrays* arrays)
+{
+	inputHelper_.getStringValue(arrays, TouchInputName::URL, parameters_.currentUrl_);
+	inputHelper_.getStringValue(arrays, TouchInputName::Thumbnail, parameters_.thumbnailUrl_);
+	inputHelper_.getFloatValue(arrays, TouchInputName::PlaylistIndex, parameters_.playlistIndex_);
+	inputHelper_.getFloatValue(arrays, TouchInputName::PrefetchDepth, parameters_.prefetchDepth_);
+	inputHelper_.getFloatValue(arrays, TouchInputName::PrefetchBudget, parameters_.prefetchBudgetMb_);
+	inputHelper_.getFloatValue(arrays, TouchInputName::ParallelPrefetches, parameters_.parallelPrefetches_);
+
+	if (!inputHelper_.getRawStringValue(arrays, TouchInputName::Playlist, playlistInput_))
+		playlistInput_.clear();
+	updatePlaylist(playlistInput_);
+	inputHelper_.getBoolValue(arrays, TouchInputName::Pause, parameters_.isPaused_);
+	inputHelper_.getBoolValue(arrays, TouchInputName::Loop, parameters_.isLooping_);
+	inputHelper_.getBoolValue(arrays, TouchInputName::Blackout, parameters_.blackout_);
+	inputHelper_.getBoolValue(arrays, TouchInputName::ThumbnailOn, parameters_.thumbnailOn_);
+	inputHelper_.getBoolValue(arrays, TouchInputName::AsyncUpload, parameters_.asyncUpload_);
+	inputHelper_.getBoolValue(arrays, TouchInputName::FitOutput, parameters_.fitToOutput_);
+	inputHelper_.getFloatValue(arrays, TouchInputName::MemoryClipSize, parameters_.memoryClipSizeMb_);
+	inputHelper_.getFloatValue(arrays, TouchInputName::LoopCacheSec, parameters_.loopCacheSec_);
+	inputHelper_.getFloatValue(arrays, TouchInputName::TransitionType, parameters_.transitionType_);
+	inputHelper_.getFloatValue(arrays, TouchInputName::TransitionTime, parameters_.transitionTimeSec_);
+	inputHelper_.updateFloatValue(arrays, TouchInputName::SeekPosition, parameters_.isNewSeekValue_, parameters_.lastSeekPosition_);
+	inputHelper_.updateFloatValue(arrays, TouchInputName::PlaybackSpeed, parameters_.isNewPlaybackSpeed_, parameters_.lastPlaybackSpeed_);
+	inputHelper_.updateFloatValue(arrays, TouchInputName::StartTime, parameters_.isNewStartTime_, parameters_.lastStartTimeSec_);
+	inputHelper_.updateFloatValue(arrays, TouchInputName::EndTime, parameters_.isNewEndTime_, parameters_.lastEndTimeSec_);
+	inputHelper_.updateFloatValue(arrays, TouchInputName::ChromaMode, parameters_.isNewChromaMode_, parameters_.lastChromaMode_);
+
+	bool switchOnCue = false;
+	inputHelper_.getBoolValue(arrays, TouchInputName::SwitchOnCue, switchOnCue);
+	parameters_.seamlessModeOn_ = !switchOnCue;
+
+	if (!parameters_.seamlessModeOn_)
+		inputHelper_.updateFloatValue(arrays, TouchInputName::SwitchCue, parameters_.switchCue_, parameters_.lastSwitchCueValue_);
+	else
+		parameters_.switchCue_ = 0;
+}
 
-	if (frameData_)
+void
+YouTubeTOP::renderBlackFrame()
+{
+	if (texture_.isValid())
 	{
-		log("deallocating texture data");
+		glClearColor(0., 0., 0., 1.);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+}
+
+bool
+YouTubeTOP::isSteadyState() const
+{
+	// one stream is playing - nothing is opened, staged, blended or buffered
+	return (status_ == Running && handoverStatus_ == NoHandover && !transition_.isActive() &&
+		prefetcher_.getNBuffering() == 0 && !parameters_.thumbnailOn_ &&
+		activeControllerStatus_.state_ == libvlc_Playing);
+}
+
+bool
+YouTubeTOP::needsCooking() const
+{
+	// thumbnail is being opened
+	if (parameters_.thumbnailOn_ && !thumbnailReady_ && parameters_.thumbnailUrl_ != "")
+		return true;
+
+	// URL is being opened
+	if (status_ == None)
+		return (parameters_.currentUrl_ != "" && activeControllerStatus_.state_ != libvlc_Error);
 
-		free(frameData_);
+	// handover is staging or blending in
+	if (handoverStatus_ == Initiated || transition_.isActive())
+		return true;
+
+	// prefetcher pauses controllers only on update
+	if (prefetcher_.getNBuffering() > 0)
+		return true;
+
+	if (parameters_.thumbnailOn_)
+		return false;
+
+	if (status_ != Running || parameters_.blackout_)
+		return false;
+
+	const YouTubeTOP* source = (leader_ ? leader_ : this);
+
+	if (source->isPlayingLoopCache_)
+		return true;
+
+	switch (activeControllerStatus_.state_)
+	{
+	case libvlc_Error:
+		return false;
+	case libvlc_Ended:
+		// loop restarts on next cook
+		return parameters_.isLooping_;
+	default:
+		return true;
 	}
+}
 
-	frameData_ = malloc(activeControllerStatus_.videoInfo_.frameSize_);
-	memset(frameData_, 0, activeControllerStatus_.videoInfo_.frameSize_);
+void
+YouTubeTOP::performTransition()
+{
+	parameters_.switchCue_ = false;
+	handoverStatus_ = HandoverStatus::NoHandover;
+
+	int type = std::min(std::max((int)parameters_.transitionType_, (int)Transition::Cut), (int)Transition::Wipe);
+	// loops and restarts of the same URL are always cut
+	bool isBlending = (type != Transition::Cut && parameters_.transitionTimeSec_ > 0 &&
+		isHandoverStaged_ && texture_.isValid() &&
+		activeControllerStatus_.videoUrl_ != handoverControllerStatus_.videoUrl_);
 
-	log("new texture allocated - %d bytes (%dX%d)", activeControllerStatus_.videoInfo_.frameSize_, 
-		activeControllerStatus_.videoInfo_.width_, activeControllerStatus_.videoInfo_.height_);
+	// previous blend is cut short
+	finishTransition();
 
-	if (glIsTexture(texture_))
+	if (isBlending)
 	{
-		log("delete texture");
+		// outgoing stream keeps playing until it's blended out. its audio
+		// isn't mixed in - subscribers get incoming stream's audio only
+		outgoingController_ = activeController_;
+		outgoingFrameNo_ = 0;
+		activeController_ = handoverController_;
+		handoverController_ = streamControllers_.acquire();
+		handoverController_->setChroma(chroma_);
+		if (parameters_.lastPlaybackSpeed_ > 0)
+			handoverController_->setPlaybackSpeed(parameters_.lastPlaybackSpeed_);
+
+		activeController_->getStatus(activeControllerStatus_);
+		handoverController_->getStatus(handoverControllerStatus_);
+	}
+	else
+	{
+		activeController_->stop();
+		swapControllers();
+	}
+
+	// record next pass unless it's cached already
+	stopLoopCache();
+	if (loopCache_.getUrl() != parameters_.currentUrl_)
+		loopCache_.reset();
+	loopCacheArmed_ = (loopCache_.getState() == LoopCache::Idle);
 
-		glDeleteTextures(1, (const GLuint*)&texture_);
-		GetError();
-		texture_ = 0;
+	if (isHandoverStaged_)
+	{
+		// first frame is on GPU already - show it without waiting for decoder
+		if (isBlending)
+			outgoingTexture_.swap(texture_);
+		texture_.swap(stagingTexture_);
+
+		if (isBlending)
+		{
+			log("%s transition for %.2f sec", Transition::getTypeString((Transition::Type)type).c_str(), parameters_.transitionTimeSec_);
+
+			transition_.start((Transition::Type)type, (int64_t)(parameters_.transitionTimeSec_ * 1000.));
+			if (!parameters_.blackout_)
+				transition_.draw(outgoingTexture_, texture_, texture_.getWidth(), texture_.getHeight());
+		}
+		else if (!parameters_.blackout_)
+			texture_.draw(texture_.getWidth(), texture_.getHeight());
 	}
+	else if (activeControllerStatus_.videoInfo_.width_ != texture_.getWidth() ||
+		activeControllerStatus_.videoInfo_.height_ != texture_.getHeight() ||
+		activeControllerStatus_.videoInfo_.chroma_ != texture_.getChroma())
+		initTexture();
 
-	log("creating new texture (%dX%d)...", activeControllerStatus_.videoInfo_.width_, activeControllerStatus_.videoInfo_.height_);
-	texture_ = createVideoTexture(activeControllerStatus_.videoInfo_.width_, activeControllerStatus_.videoInfo_.height_, frameData_);
-	log("new texture created");
+	// set spare controller to prebuffer current video
+	resetHandoverStage();
+	handoverController_->play(parameters_.currentUrl_, 
+		frameCallback_, 
+		audioCallback_,
+		handoverController_);
+
+	// stream was withdrawn when handover was initiated
+	if (StreamRegistry::publish(getStreamKey(), this))
+		log("sharing stream with other TOPs");
 }
 
 void
-YouTubeTOP::initThumbnailTexture()
+YouTubeTOP::stageHandoverFrame()
 {
+	// start time past the end isn't seeked to
+	int64_t targetMs = (startTimeMs_ < handoverControllerStatus_.videoInfo_.totalTime_ ? startTimeMs_ : 0);
 
-	if (thumbnailFrameData_)
+	if (!isHandoverStaged_ && handoverInfoStaled_ && !needAdjustStartTimeHandover_ &&
+		handoverControllerStatus_.nPendingCommands_ == 0 &&
+		handoverControllerStatus_.state_ == libvlc_Playing &&
+		handoverControllerStatus_.videoInfo_.currentTime_ + HandoverStageToleranceMs >= targetMs)
 	{
-		log("deallocating thumbnail texture data");
+		StreamController::FrameRef frame = handoverController_->getLatestFrame();
 
-		free(thumbnailFrameData_);
-	}
+		if (frame && frame.frameNo() > handoverSeekFrameNo_ &&
+			frame.width() == handoverControllerStatus_.videoInfo_.width_ &&
+			frame.height() == handoverControllerStatus_.videoInfo_.height_)
+		{
+			log("staging handover frame at %d ms", (int)handoverControllerStatus_.videoInfo_.currentTime_);
+
+			// hold it there until switch
+			handoverController_->pause(true);
 
-	thumbnailFrameData_ = malloc(thumbnailControllerStatus().videoInfo_.frameSize_);
-	memset(thumbnailFrameData_, 0, thumbnailControllerStatus().videoInfo_.frameSize_);
+			if (frame.width() != stagingTexture_.getWidth() || frame.height() != stagingTexture_.getHeight() ||
+				frame.chroma() != stagingTexture_.getChroma())
+				stagingTexture_.init(frame.chroma(), frame.width(), frame.height());
 
-	log("new thumbnail texture allocated - %d bytes (%dX%d)", thumbnailControllerStatus().videoInfo_.frameSize_,
-		thumbnailControllerStatus().videoInfo_.width_, thumbnailControllerStatus().videoInfo_.height_);
+			stagingTexture_.setAsync(parameters_.asyncUpload_);
+			stagingTexture_.upload(frame);
+			GetError();
+			isHandoverStaged_ = true;
+		}
+	}
 
-	if (glIsTexture(thumbnail_))
+	if (handoverStatus_ == HandoverStatus::Initiated && isHandoverStaged_)
 	{
-		log("delete thumbnail texture");
+		log("finishing up handover. first frame staged");
 
-		glDeleteTextures(1, (const GLuint*)&thumbnail_);
-		GetError();
-		thumbnail_ = 0;
+		handoverStatus_ = HandoverStatus::Ready;
 	}
-
-	log("creating new texture (%dX%d)...", thumbnailControllerStatus_.videoInfo_.width_, thumbnailControllerStatus_.videoInfo_.height_);
-	thumbnail_ = createVideoTexture(thumbnailControllerStatus_.videoInfo_.width_, thumbnailControllerStatus_.videoInfo_.height_, thumbnailFrameData_);
-	log("new texture created");
 }
 
 void
-YouTubeTOP::updateParameters(const TOP_InputArrays* arrays)
+YouTubeTOP::renderTransitionFrame()
 {
-	TouchInputHelper<TOP_InputArrays, TouchInputName> inputHelper(TouchInputs);
-
-	inputHelper.getStringValue(arrays, TouchInputName::URL, parameters_.currentUrl_);
-	inputHelper.getStringValue(arrays, TouchInputName::Thumbnail, parameters_.thumbnailUrl_);
-	inputHelper.getBoolValue(arrays, TouchInputName::Pause, parameters_.isPaused_);
-	inputHelper.getBoolValue(arrays, TouchInputName::Loop, parameters_.isLooping_);
-	inputHelper.getBoolValue(arrays, TouchInputName::Blackout, parameters_.blackout_);
-	inputHelper.getBoolValue(arrays, TouchInputName::ThumbnailOn, parameters_.thumbnailOn_);
-	inputHelper.updateFloatValue(arrays, TouchInputName::SeekPosition, parameters_.isNewSeekValue_, parameters_.lastSeekPosition_);
-	inputHelper.updateFloatValue(arrays, TouchInputName::PlaybackSpeed, parameters_.isNewPlaybackSpeed_, parameters_.lastPlaybackSpeed_);
-	inputHelper.updateFloatValue(arrays, TouchInputName::StartTime, parameters_.isNewStartTime_, parameters_.lastStartTimeSec_);
-	inputHelper.updateFloatValue(arrays, TouchInputName::EndTime, parameters_.isNewEndTime_, parameters_.lastEndTimeSec_);
+	if (isFrameUpdated_.exchange(false))
+	{
+		StreamController::FrameRef frame = activeController_->getLatestFrame();
 
-	bool switchOnCue = false;
-	inputHelper.getBoolValue(arrays, TouchInputName::SwitchOnCue, switchOnCue);
-	parameters_.seamlessModeOn_ = !switchOnCue;
+		if (frame &&
+			frame.width() == activeControllerStatus_.videoInfo_.width_ &&
+			frame.height() == activeControllerStatus_.videoInfo_.height_)
+		{
+			if (frame.width() != texture_.getWidth() || frame.height() != texture_.getHeight())
+				initTexture();
 
-	if (!parameters_.seamlessModeOn_)
-		inputHelper.updateFloatValue(arrays, TouchInputName::SwitchCue, parameters_.switchCue_, parameters_.lastSwitchCueValue_);
-	else
-		parameters_.switchCue_ = 0;
+			texture_.upload(frame);
+			recordLoopFrame(frame);
+		}
+	}
+
+	// outgoing stream isn't ours anymore - poll it
+	StreamController::FrameRef outgoing = outgoingController_->getLatestFrame();
+
+	if (outgoing && outgoing.frameNo() != outgoingFrameNo_)
+	{
+		outgoingFrameNo_ = outgoing.frameNo();
+
+		if (outgoing.width() != outgoingTexture_.getWidth() || outgoing.height() != outgoingTexture_.getHeight() ||
+			outgoing.chroma() != outgoingTexture_.getChroma())
+			outgoingTexture_.init(outgoing.chroma(), outgoing.width(), outgoing.height());
+
+		outgoingTexture_.setAsync(parameters_.asyncUpload_);
+		outgoingTexture_.upload(outgoing);
+	}
+	outgoing.release();
+
+	transition_.draw(outgoingTexture_, texture_, texture_.getWidth(), texture_.getHeight());
 }
 
 void
-YouTubeTOP::renderBlackFrame()
+YouTubeTOP::finishTransition()
 {
-	if (frameData_)
+	transition_.stop();
+
+	if (outgoingController_)
 	{
-		ScopedLock lock(frameBufferAcces_);
-		memset(frameData_, 0, activeControllerStatus_.videoInfo_.frameSize_);
-		renderTexture(texture_, activeControllerStatus_.videoInfo_.width_, activeControllerStatus_.videoInfo_.height_, frameData_);
+		log("transition finished. releasing outgoing controller");
+
+		// stop is queued - player shuts down on its worker thread
+		streamControllers_.release(outgoingController_);
+		outgoingController_ = nullptr;
 	}
 }
 
 void
-YouTubeTOP::performTransition()
+YouTubeTOP::resetHandoverStage()
 {
-	int oldWidth = activeControllerStatus_.videoInfo_.width_;
-	int oldHeight = activeControllerStatus_.videoInfo_.height_;
+	// handover decodes again until it has a frame to stage
+	isHandoverStaged_ = false;
+	handoverInfoStaled_ = false;
+	handoverSeekFrameNo_ = 0;
+}
 
-	parameters_.switchCue_ = false;
-	handoverStatus_ = HandoverStatus::NoHandover;
-	activeController_->stop();
-	swapControllers();
+void
+YouTubeTOP::updatePlaylist(const std::string& playlistText)
+{
+	if (playlistText != parameters_.playlistText_)
+	{
+		parameters_.playlistText_ = playlistText;
+		playlist_ = PlaylistPrefetcher::parse(playlistText);
 
-	if (activeControllerStatus_.videoInfo_.width_ != oldWidth ||
-		activeControllerStatus_.videoInfo_.height_ != oldHeight)
-		initTexture();
+		log("new playlist with %d items", (int)playlist_.size());
+	}
 
-	// set spare controller to prebuffer current video
-	handoverController_->play(parameters_.currentUrl_, 
-		std::bind(&YouTubeTOP::onFrameRendering, this, _1, _2), 
-		std::bind(&YouTubeTOP::onAudioData, this, _1, _2),
-		handoverController_);
+	if (!playlist_.empty())
+	{
+		int idx = (int)parameters_.playlistIndex_ % (int)playlist_.size();
+		parameters_.currentUrl_ = playlist_[(idx < 0 ? idx + playlist_.size() : idx)];
+	}
 }
 
 void
-YouTubeTOP::swapControllers()
+YouTubeTOP::updatePrefetcher()
 {
-	if (activeController_ == streamControllers_.getFirst())
+	// followers don't decode anything
+	if (playlist_.empty() || leader_)
 	{
-		activeController_ = streamControllers_.getSecond();
-		handoverController_ = streamControllers_.getFirst();
+		prefetcher_.clear();
+		return;
 	}
-	else
+
+	// items that follow the current one, wrapping around
+	std::vector<std::string>& urls = prefetchUrls_;
+	unsigned depth = (unsigned)std::max(parameters_.prefetchDepth_, 0.f);
+	int idx = (int)parameters_.playlistIndex_;
+
+	// just selected - keep it until it's taken
+	bool isLoaded = (parameters_.currentUrl_ == activeControllerStatus_.videoUrl_ ||
+		parameters_.currentUrl_ == handoverControllerStatus_.videoUrl_);
+
+	// strings are assigned rather than rebuilt, they keep their capacity
+	size_t nUrls = 0;
+
+	if (!isLoaded)
+		assignUrl(urls, nUrls++, parameters_.currentUrl_);
+
+	for (unsigned i = 1; i <= depth && i < playlist_.size(); ++i)
 	{
-		activeController_ = streamControllers_.getFirst();
-		handoverController_ = streamControllers_.getSecond();
+		int next = (idx + (int)i) % (int)playlist_.size();
+		assignUrl(urls, nUrls++, playlist_[(next < 0 ? next + playlist_.size() : next)]);
 	}
 
-	activeControllerStatus_ = activeController_->getStatus();
-	handoverControllerStatus_ = handoverController_->getStatus();
+	urls.resize(nUrls);
+
+	prefetcher_.update(urls, (unsigned)urls.size(), 
+		(size_t)(std::max(parameters_.prefetchBudgetMb_, 0.f) * (1 << 20)),
+		(unsigned)std::max(parameters_.parallelPrefetches_, 1.f));
+}
+
+void
+YouTubeTOP::startPrefetch(StreamController* controller, const std::string& url)
+{
+	controller->setChroma(chroma_);
+	controller->play(url,
+		frameCallback_,
+		audioCallback_,
+		controller);
+
+	log("prefetching %s", url.c_str());
+}
+
+bool
+YouTubeTOP::takePrefetched(StreamController** controller, StreamController::Status& status)
+{
+	StreamController* prefetched = prefetcher_.take(parameters_.currentUrl_);
+
+	if (!prefetched)
+		return false;
+
+	streamControllers_.release(*controller);
+	*controller = prefetched;
+
+	if (parameters_.lastPlaybackSpeed_ > 0)
+		prefetched->setPlaybackSpeed(parameters_.lastPlaybackSpeed_);
+
+	prefetched->getStatus(status);
+	log("switching to prefetched %s", parameters_.currentUrl_.c_str());
+
+	return true;
+}
+
+void
+YouTubeTOP::swapControllers()
+{
+	std::swap(activeController_, handoverController_);
+
+	activeController_->getStatus(activeControllerStatus_);
+	handoverController_->getStatus(handoverControllerStatus_);
 }
 
 void
@@ -1034,6 +1616,275 @@ YouTubeTOP::swapControllers(vlc::StreamController** controller1, vlc::StreamCont
 	*controller2 = (vlc::StreamController*)tmp;
 }
 
+const StreamKey&
+YouTubeTOP::getStreamKey() const
+{
+	streamKey_.url_ = parameters_.currentUrl_;
+	streamKey_.startTimeMs_ = startTimeMs_;
+	streamKey_.speed_ = parameters_.lastPlaybackSpeed_;
+	streamKey_.maxWidth_ = maxWidth_;
+	streamKey_.maxHeight_ = maxHeight_;
+	streamKey_.chroma_ = (int)chroma_;
+
+	return streamKey_;
+}
+
+void
+YouTubeTOP::republishStream()
+{
+	StreamRegistry::withdraw(this);
+
+	// only a stream we decode ourselves, once it's loaded
+	if (!leader_ && parameters_.currentUrl_ != "" &&
+		activeControllerStatus_.videoUrl_ == parameters_.currentUrl_ &&
+		StreamRegistry::publish(getStreamKey(), this))
+		log("sharing stream with other TOPs");
+}
+
+bool
+YouTubeTOP::canLead(const YouTubeTOP* follower) const
+{
+	// follower renders exactly what we do, so playback state must match
+	// frames must be of the size and format follower would decode itself.
+	// chroma change takes effect on next load, so decoded one is checked too
+	return !leader_ && !parameters_.isPaused_ && !parameters_.thumbnailOn_ &&
+		parameters_.isLooping_ == follower->parameters_.isLooping_ &&
+		activeControllerStatus_.state_ != libvlc_Error &&
+		getStreamKey() == follower->getStreamKey() &&
+		(!activeControllerStatus_.isVideoInfoReady_ ||
+			activeControllerStatus_.videoInfo_.chroma_ == follower->chroma_);
+}
+
+YouTubeTOP*
+YouTubeTOP::getLeader()
+{
+	// leader can only be gone if set of TOPs has changed
+	if (leader_ && SharedData::getGeneration() != leaderGeneration_)
+	{
+		uint64_t generation = SharedData::getGeneration();
+
+		if (SharedData::getTop(leaderPath_) != leader_)
+			leaveLeader();
+		else
+			leaderGeneration_ = generation;
+	}
+
+	return leader_;
+}
+
+bool
+YouTubeTOP::followLeader()
+{
+	YouTubeTOP* leader = nullptr;
+
+	// paused playback and playback resumed after leaving are not shared
+	if (parameters_.currentUrl_ != "" && !parameters_.isPaused_ &&
+		!parameters_.thumbnailOn_ && resumeTimeMs_ < 0)
+		leader = StreamRegistry::find(getStreamKey());
+
+	if (leader == this || (leader && !leader->canLead(this)))
+		leader = nullptr;
+
+	if (leader != getLeader())
+	{
+		leaveLeader();
+
+		if (leader)
+			joinLeader(leader);
+	}
+
+	return (leader_ != nullptr);
+}
+
+void
+YouTubeTOP::joinLeader(YouTubeTOP* leader)
+{
+	// own decoders are not needed while we render leader's frames
+	activeController_->stop();
+	handoverController_->stop();
+	handoverStatus_ = HandoverStatus::NoHandover;
+	resetHandoverStage();
+	finishTransition();
+
+	leader_ = leader;
+	leaderPath_ = leader->getNodeFullPath();
+	leaderGeneration_ = SharedData::getGeneration();
+	lastFrameSource_ = nullptr;
+	resumeTimeMs_ = -1;
+
+	std::shared_ptr<const AudioSubscribers> subscribers = std::atomic_load(&audioSubscribers_);
+
+	if (subscribers)
+		for (auto& s : *subscribers)
+			leader->subscribeAudio(s);
+
+	log("rendering stream decoded by %s", leaderPath_.c_str());
+}
+
+void
+YouTubeTOP::leaveLeader()
+{
+	if (!leader_)
+		return;
+
+	YouTubeTOP* leader = (SharedData::getTop(leaderPath_) == leader_ ? leader_ : nullptr);
+
+	leader_ = nullptr;
+
+	if (leader)
+	{
+		// own playback continues from where shared one is, unless it's
+		// a different stream
+		if (leader->getStreamKey() == getStreamKey())
+			resumeTimeMs_ = (int)leader->activeControllerStatus_.videoInfo_.currentTime_;
+
+		std::shared_ptr<const AudioSubscribers> subscribers = std::atomic_load(&audioSubscribers_);
+
+		if (subscribers)
+			for (auto& s : *subscribers)
+				leader->unsubscribeAudio(s);
+	}
+
+	status_ = Status::None;
+	isFrameUpdated_ = false;
+	activeInfoStaled_ = false;
+	lastFrameSource_ = nullptr;
+	activeController_->getStatus(activeControllerStatus_);
+
+	log("stopped rendering stream decoded by %s", leaderPath_.c_str());
+}
+
+void
+YouTubeTOP::renderLeaderFrame()
+{
+	status_ = leader_->status_;
+
+	if (status_ != Running)
+		return;
+
+	if (parameters_.blackout_)
+	{
+		renderBlackFrame();
+		return;
+	}
+
+	// leader's decoder is idle while it loops from memory
+	if (leader_->isPlayingLoopCache_)
+	{
+		if (leader_->lastLoopFrameIdx_ >= 0 && leader_->lastLoopFrameIdx_ != lastLoopFrameIdx_)
+		{
+			lastLoopFrameIdx_ = leader_->lastLoopFrameIdx_;
+			lastFrameSource_ = nullptr;
+			uploadLoopCacheFrame(leader_->loopCache_, lastLoopFrameIdx_);
+		}
+
+		return;
+	}
+
+	lastLoopFrameIdx_ = -1;
+	StreamController::FrameRef frame = leader_->activeController_->getLatestFrame();
+
+	if (!frame ||
+		(leader_->activeController_ == lastFrameSource_ && frame.frameNo() == lastFrameNo_))
+		return;
+
+	if (frame.width() != texture_.getWidth() || frame.height() != texture_.getHeight() ||
+		frame.chroma() != texture_.getChroma())
+		texture_.init(frame.chroma(), frame.width(), frame.height());
+
+	texture_.upload(frame);
+	texture_.draw(frame.width(), frame.height());
+	lastFrameSource_ = leader_->activeController_;
+	lastFrameNo_ = frame.frameNo();
+}
+
+bool
+YouTubeTOP::canCacheLoop() const
+{
+	double fps = activeControllerStatus_.videoInfo_.fps_;
+	int64_t loopMs = activeControllerStatus_.videoInfo_.totalTime_ - startTimeMs_;
+
+	// CHOPs would go silent while loop plays from cache
+	return (parameters_.loopCacheSec_ > 0 && parameters_.isLooping_ && fps > 0 &&
+		loopMs > 0 && loopMs <= parameters_.loopCacheSec_ * 1000. && !hasAudioSubscribers());
+}
+
+bool
+YouTubeTOP::hasAudioSubscribers() const
+{
+	std::shared_ptr<const AudioSubscribers> subscribers = std::atomic_load(&audioSubscribers_);
+
+	return (subscribers && !subscribers->empty());
+}
+
+void
+YouTubeTOP::recordLoopFrame(const StreamController::FrameRef& frame)
+{
+	if (loopCacheArmed_)
+	{
+		loopCacheArmed_ = false;
+
+		if (canCacheLoop())
+		{
+			loopCache_.start(activeControllerStatus_.videoUrl_, activeControllerStatus_.videoInfo_.fps_);
+			log("recording loop pass into cache");
+		}
+	}
+
+	if (loopCache_.getState() == LoopCache::Recording &&
+		!loopCache_.record(frame))
+		log("loop is too large or has changed format. not caching it");
+}
+
+void
+YouTubeTOP::startLoopCache()
+{
+	log("playing loop from cache: %d frames %.1f MB", (int)loopCache_.getNFrames(),
+		(double)loopCache_.getSize() / (1 << 20));
+
+	isPlayingLoopCache_ = true;
+	loopTimeMs_ = 0;
+	lastLoopTick_ = std::chrono::steady_clock::now();
+	lastLoopFrameIdx_ = -1;
+}
+
+void
+YouTubeTOP::stopLoopCache()
+{
+	isPlayingLoopCache_ = false;
+	lastLoopFrameIdx_ = -1;
+}
+
+void
+YouTubeTOP::renderLoopCacheFrame()
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	double speed = (parameters_.lastPlaybackSpeed_ > 0 ? parameters_.lastPlaybackSpeed_ : 1.);
+
+	loopTimeMs_ += std::chrono::duration<double, std::milli>(now - lastLoopTick_).count() * speed;
+	loopTimeMs_ = fmod(loopTimeMs_, (double)loopCache_.getDuration());
+	lastLoopTick_ = now;
+
+	int frameIdx = (int)loopCache_.getFrameIdx((int64_t)loopTimeMs_);
+
+	if (frameIdx != lastLoopFrameIdx_)
+	{
+		lastLoopFrameIdx_ = frameIdx;
+		uploadLoopCacheFrame(loopCache_, frameIdx);
+	}
+}
+
+void
+YouTubeTOP::uploadLoopCacheFrame(const LoopCache& cache, unsigned frameIdx)
+{
+	if (cache.getWidth() != texture_.getWidth() || cache.getHeight() != texture_.getHeight() ||
+		cache.getChroma() != texture_.getChroma())
+		texture_.init(cache.getChroma(), cache.getWidth(), cache.getHeight());
+
+	texture_.upload(cache.getPlanes(frameIdx), cache.getPitches());
+	texture_.draw(cache.getWidth(), cache.getHeight());
+}
+
 FILE*
 YouTubeTOP::initLogFile()
 {
@@ -1075,41 +1926,11 @@ bool fileExist(const char *fileName)
 	return infile.good();
 }
 
-int
-createVideoTexture(unsigned width, unsigned height, void *frameBuffer)
+static void assignUrl(std::vector<std::string>& urls, size_t idx, const std::string& url)
 {
-	int texture = 0;
-
-	glGenTextures(1, (GLuint*)&texture);
-	GetError();
-
-	glBindTexture(GL_TEXTURE_2D, texture);
-	GetError();
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	GetError();
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	GetError();
-
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-	GetError();
-
-	return texture;
+	if (idx < urls.size())
+		urls[idx] = url;
+	else
+		urls.push_back(url);
 }
 
-void
-renderTexture(GLuint texId, unsigned width, unsigned height, void* data)
-{
-	glEnable(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, texId);
-	glLoadIdentity();
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
-
-	glBegin(GL_QUADS);
-	// the reason why texture coordinates are weird - the texture is flipped horizontally
-	glTexCoord2f(0., 1.); glVertex2i(0, 0);
-	glTexCoord2f(1., 1.); glVertex2i(width, 0);
-	glTexCoord2f(1., 0.); glVertex2i(width, height);
-	glTexCoord2f(0., 0.); glVertex2i(0, height);
-	glEnd();
-}
@@ -20,18 +20,28 @@
 
 #include <mutex>
 #include <chrono>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
 
 #include "TOP_CPlusPlusBase.h"
 #include "stream_controller.h"
 #include "touch_helpers.h"
+#include "video_texture.h"
+#include "loop_cache.h"
+#include "playlist_prefetcher.h"
+#include "transition.h"
+#include "audio_subscription.h"
+#include "shared_data.h"
+#include "allocation_counter.h"
 
 #define LIB_VERSION "1.1.0"
 
 class YouTubeTOP : public TOP_CPlusPlusBase
 {
 public:
-	typedef std::function<void(const vlc::StreamController::AudioData)> AudioCallback;
-
 	YouTubeTOP(const TOP_NodeInfo *info);
 	virtual ~YouTubeTOP();
 
@@ -58,10 +68,43 @@ public:
 	const char*			getInfoPopupString();
 
 	std::string			getNodeFullPath() const;
-	void				registerAudioCallback(AudioCallback callback);
+	// any number of subscribers receive the same audio blocks
+	void				subscribeAudio(const std::shared_ptr<audio::Subscription>& subscription);
+	void				unsubscribeAudio(const std::shared_ptr<audio::Subscription>& subscription);
 
 	bool				getIsPlaying();
 
+	/**
+	 * This enum identifies all TouchDesigner's inputs that are
+	 * used in this CPlusPlusTOP
+	 */
+	enum class TouchInputName {
+		URL,
+		Pause,
+		Loop,
+		SeekPosition,
+		SwitchOnCue,
+		SwitchCue,
+		PlaybackSpeed,
+		StartTime,
+		EndTime,
+		Blackout,
+		Thumbnail,
+		ThumbnailOn,
+		AsyncUpload,
+		ChromaMode,
+		FitOutput,
+		MemoryClipSize,
+		LoopCacheSec,
+		Playlist,
+		PlaylistIndex,
+		PrefetchDepth,
+		PrefetchBudget,
+		ParallelPrefetches,
+		TransitionType,
+		TransitionTime
+	};
+
 private:
 	typedef enum _Status {
 		None,
@@ -92,11 +135,28 @@ private:
 		bool isNewEndTime_;
 		float lastEndTimeSec_;
 		bool thumbnailOn_;
+		bool asyncUpload_;
+		// decode no larger than TOP's resolution
+		bool fitToOutput_;
+		// clips up to this size are played from RAM (libvlc 3.0 and later)
+		float memoryClipSizeMb_;
+		// loops up to this long are played from decoded frames
+		float loopCacheSec_;
+		bool isNewChromaMode_;
+		float lastChromaMode_;
+		// one URL per line; overrides URL when not empty
+		std::string playlistText_;
+		float playlistIndex_;
+		float prefetchDepth_, prefetchBudgetMb_, parallelPrefetches_;
+		// Transition::Type used when switching to another URL
+		float transitionType_, transitionTimeSec_;
 	} Parameters;
 
 	Status status_;
 	HandoverStatus handoverStatus_;
 	Parameters parameters_;
+	// kept between cooks - wiring is validated only when inputs change
+	TouchInputHelper<TOP_InputArrays, TouchInputName> inputHelper_;
 
 	// We don't need to store this pointer, but we do for the example.
 	// The TOP_NodeInfo class store information about the node that's using
@@ -105,83 +165,187 @@ private:
 	
 	std::string libVersion_ = LIB_VERSION;
 	FILE* logFile_;
-	std::mutex frameBufferAcces_, thumbnailBufferAcces_;
-	std::mutex audioCallbackMutex_;
-	void* frameData_ = nullptr;
-	void* thumbnailFrameData_ = nullptr;
-	bool isFrameUpdated_;
+	// taken by audio thread, guards against two controllers' threads
+	// producing at once during handover
+	std::mutex audioProducerMutex_;
+	// serializes changes of subscribers list
+	std::mutex audioSubscribersMutex_;
+	std::atomic<bool> isFrameUpdated_;
 	int startTimeMs_, endTimeSec_;
 	bool needAdjustStartTimeHandover_, needAdjustStartTimeActive_;
 	bool activeInfoStaled_, handoverInfoStaled_;
 	int cookNextFrames_;
-	bool thumbnailReady_;
-	AudioCallback audioCallback_;
-
-	unsigned texture_, thumbnail_;
+	std::atomic<bool> thumbnailReady_;
+	typedef std::vector<std::shared_ptr<audio::Subscription>> AudioSubscribers;
+	// copy-on-write, audio thread loads it atomically
+	std::shared_ptr<const AudioSubscribers> audioSubscribers_;
+	// bound once - controllers are given copies of these
+	vlc::StreamController::OnRendering frameCallback_, thumbnailCallback_;
+	vlc::StreamController::OnAudioData audioCallback_;
+
+	VideoTexture texture_, thumbnail_;
+	// first frame of handover at start time, shown right on switch
+	VideoTexture stagingTexture_;
+	bool isHandoverStaged_;
+	// frames up to this one were decoded before handover seeked to start
+	uint64_t handoverSeekFrameNo_;
+	// thumbnail is uploaded once per decoded frame
+	uint64_t lastThumbnailFrameNo_;
+
+	Transition transition_;
+	// last frames of previous stream while it's blended into active one
+	VideoTexture outgoingTexture_;
+	vlc::StreamController* outgoingController_;
+	uint64_t outgoingFrameNo_;
 
 	// In this example this value will be incremented each time the execute()
 	// function is called, then passes back to the TOP 
 	int	 myExecuteCount;
 
-	class StreamControllerPair {
+	/*
+	Owns every controller of the TOP. Active and handover controllers and
+	playlist prefetches take controllers from it and give them back when
+	they're not needed, so players are created once and then reused.
+	*/
+	class StreamControllerPool {
 	public:
-		StreamControllerPair(std::string name1, std::string name2):
-		streamController_(name1), spareController_(name2){}
-
-		vlc::StreamController* getFirst()
+		vlc::StreamController* acquire()
 		{
-			return &streamController_;
+			if (free_.empty())
+				return create();
+
+			vlc::StreamController* controller = free_.back();
+			free_.pop_back();
+
+			return controller;
 		}
 
-		vlc::StreamController* getSecond()
+		// keeps one idle controller ready, so that a switch doesn't have 
+		// to create a player on cook thread
+		void reserveSpare()
 		{
-			return &spareController_;
+			if (free_.empty())
+				free_.push_back(create());
 		}
 
-		const vlc::StreamController::Status* getFirstStatus()
+		void release(vlc::StreamController* controller)
 		{
-			return &streamController_.getStatus();
+			controller->stop();
+			free_.push_back(controller);
 		}
 
-		const vlc::StreamController::Status* getSecondsStatus()
+		// applies settings to every controller, idle ones included
+		template<typename F>
+		void forEach(F f)
 		{
-			return &spareController_.getStatus();
+			for (auto& c : controllers_)
+				f(c.get());
 		}
 
+		unsigned size() const { return (unsigned)controllers_.size(); }
+
 	private:
-		vlc::StreamController streamController_;
-		vlc::StreamController spareController_;
+		std::vector<std::unique_ptr<vlc::StreamController>> controllers_;
+		std::vector<vlc::StreamController*> free_;
+
+		vlc::StreamController* create()
+		{
+			controllers_.emplace_back(new vlc::StreamController("controller" + std::to_string(controllers_.size() + 1)));
+			return controllers_.back().get();
+		}
 	};
 
-	StreamControllerPair streamControllers_;
+	StreamControllerPool streamControllers_;
+	PlaylistPrefetcher prefetcher_;
+	std::vector<std::string> playlist_;
+	// reused every cook, so that they keep their capacity
+	std::string playlistInput_;
+	std::vector<std::string> prefetchUrls_;
 
 	vlc::StreamController* activeController_;
 	vlc::StreamController::Status activeControllerStatus_;
 	vlc::StreamController* handoverController_;
 	vlc::StreamController::Status handoverControllerStatus_;
-	vlc::StreamController* thumbnailController_;
+	std::unique_ptr<vlc::StreamController> thumbnailController_;
+	// applied to controllers taken from the pool
+	vlc::StreamController::Chroma chroma_;
+	// bound controllers decode within, zero means native size
+	unsigned maxWidth_, maxHeight_;
 	vlc::StreamController::Status thumbnailControllerStatus_;
 
 	bool videoFormatReady_;
 
+	// TOP that decodes the stream we render, when we don't decode it
+	// ourselves. validated through SharedData before use
+	YouTubeTOP* leader_;
+	std::string leaderPath_;
+	// SharedData generation leader_ was last validated at
+	uint64_t leaderGeneration_;
+	const vlc::StreamController* lastFrameSource_;
+	uint64_t lastFrameNo_;
+	// where own playback starts after leaving leader's stream, -1 if none
+	int resumeTimeMs_;
+
+	LoopCache loopCache_;
+	// next pass of active controller is to be recorded
+	bool loopCacheArmed_;
+	// frames come from loopCache_; active has ended, handover is paused
+	bool isPlayingLoopCache_;
+	double loopTimeMs_;
+	std::chrono::steady_clock::time_point lastLoopTick_;
+	int lastLoopFrameIdx_;
+
+	// allocations on cook thread during last cook (YT_COUNT_ALLOCATIONS)
+	CookAllocations cookAllocations_;
+	// refreshed in place, so that looking up shared stream doesn't allocate
+	mutable StreamKey streamKey_;
+
 	void onFrameRendering(const void* frameData, const void* userData);
 	void onAudioData(const vlc::StreamController::AudioData ad, const void* userData);
 	void onThumbnailRendering(const void* frameData, const void* userData);
 	void initTexture();
 	void initThumbnailTexture();
+	void cook(const TOP_OutputFormatSpecs* outputFormat, const TOP_InputArrays* arrays);
 	void updateParameters(const TOP_InputArrays* arrays);
 	void renderBlackFrame();
+	bool needsCooking() const;
+	bool isSteadyState() const;
 
 	void performTransition();
+	void stageHandoverFrame();
+	void resetHandoverStage();
+	void renderTransitionFrame();
+	void finishTransition();
+	void updatePlaylist(const std::string& playlistText);
+	void updatePrefetcher();
+	void startPrefetch(vlc::StreamController* controller, const std::string& url);
+	bool takePrefetched(vlc::StreamController** controller, vlc::StreamController::Status& status);
 	void swapControllers();
 	void swapControllers(vlc::StreamController** controller1, vlc::StreamController** controller2);
 	vlc::StreamController* thumbnailController(){
-		return thumbnailController_;
+		return thumbnailController_.get();
 	}
 	vlc::StreamController::Status thumbnailControllerStatus(){
 		return thumbnailControllerStatus_;
 	}
 
+	const StreamKey& getStreamKey() const;
+	void republishStream();
+	bool canLead(const YouTubeTOP* follower) const;
+	YouTubeTOP* getLeader();
+	bool followLeader();
+	void joinLeader(YouTubeTOP* leader);
+	void leaveLeader();
+	void renderLeaderFrame();
+
+	bool canCacheLoop() const;
+	bool hasAudioSubscribers() const;
+	void recordLoopFrame(const vlc::StreamController::FrameRef& frame);
+	void startLoopCache();
+	void stopLoopCache();
+	void renderLoopCacheFrame();
+	void uploadLoopCacheFrame(const LoopCache& cache, unsigned frameIdx);
+
 	FILE* initLogFile();
 	void log(const char *fmt, ...);
 